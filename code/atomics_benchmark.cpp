@@ -0,0 +1,142 @@
+#include "shared.h"
+
+// NOTE: Measures atomic operations with different memory orders on one shared variable. Uncontended runs
+//       one thread, contended runs one thread per logical processor and all of them hit the same cache line.
+//       Usage: atomics_benchmark [operations per thread]
+
+enum class operation
+{
+    LoadRelaxed,
+    LoadAcquire,
+    StoreRelease,
+    StoreSequentiallyConsistent,
+    FetchAdd,
+    CompareExchangeLoop,
+};
+
+struct benchmark
+{
+    const char* Name;
+    LPTHREAD_START_ROUTINE ThreadProc;
+};
+
+struct worker
+{
+    u32 OperationCount;
+    void* StartEventHandle;
+};
+
+alignas(64) global volatile u64 Shared;
+alignas(64) global volatile u64 Sink;
+
+template<operation Operation> DWORD WINAPI WorkerProc
+(LPVOID WorkerVoidPtr)
+{
+    auto& Worker = *(worker*)WorkerVoidPtr;
+    WaitForSingleObjectEx(Worker.StartEventHandle, INFINITE, FALSE);
+    
+    u64 Sum = 0;
+    rstd_For(OperationIndex, Worker.OperationCount)
+    {
+        if constexpr(Operation == operation::LoadRelaxed)
+        {
+            Sum += AtomicLoad<memory_order::Relaxed>(Shared);
+        }
+        else if constexpr(Operation == operation::LoadAcquire)
+        {
+            Sum += AtomicLoad<memory_order::Acquire>(Shared);
+        }
+        else if constexpr(Operation == operation::StoreRelease)
+        {
+            AtomicStore<memory_order::Release>(Shared, OperationIndex);
+        }
+        else if constexpr(Operation == operation::StoreSequentiallyConsistent)
+        {
+            AtomicStore(Shared, OperationIndex);
+        }
+        else if constexpr(Operation == operation::FetchAdd)
+        {
+            AtomicFetchAdd(Shared, 1);
+        }
+        else
+        {
+            u64 Value = AtomicLoad<memory_order::Relaxed>(Shared);
+            for(;;)
+            {
+                u64 Previous = AtomicCompareExchange<memory_order::AcquireRelease>(Shared, Value + 1, Value);
+                if(Previous == Value)
+                    break;
+                Value = Previous;
+            }
+        }
+    }
+    
+    // NOTE: Keeps the loads from being optimized out
+    AtomicFetchAdd(Sink, Sum);
+    return 0;
+}
+
+// NOTE: Returns nanoseconds per operation of one thread
+fn RunBenchmark
+(arena& Arena, benchmark& Benchmark, u32 ThreadCount, u32 OperationCount, i64 PerformanceFrequency)
+{
+    Shared = 0;
+    void* StartEventHandle = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+    auto* Workers = PushArrayZero(Arena, worker, ThreadCount);
+    auto* ThreadHandles = PushArrayZero(Arena, HANDLE, ThreadCount);
+    rstd_For(ThreadIndex, ThreadCount)
+    {
+        Workers[ThreadIndex] = {OperationCount, StartEventHandle};
+        ThreadHandles[ThreadIndex] = CreateThread(0, 0, Benchmark.ThreadProc, &Workers[ThreadIndex], 0, nullptr);
+    }
+    
+    LARGE_INTEGER Begin, End;
+    QueryPerformanceCounter(&Begin);
+    SetEvent(StartEventHandle);
+    WaitForMultipleObjects(ThreadCount, ThreadHandles, TRUE, INFINITE);
+    QueryPerformanceCounter(&End);
+    
+    rstd_For(ThreadIndex, ThreadCount)
+        CloseHandle(ThreadHandles[ThreadIndex]);
+    CloseHandle(StartEventHandle);
+    
+    f64 Nanoseconds = (f64)(End.QuadPart - Begin.QuadPart) * 1000000000.0 / (f64)PerformanceFrequency;
+    return Nanoseconds / (f64)OperationCount;
+}
+
+int main
+(i32 ArgumentCount, char** Arguments)
+{
+    u32 OperationCount = ArgumentCount > 1 ? StringToU32(Arguments[1]) : 10000000;
+    RAssert(OperationCount > 0, "Number of operations has to be bigger than 0");
+    u32 ThreadCount = GetLogicalProcessorCount();
+    if(ThreadCount > MAXIMUM_WAIT_OBJECTS)
+        ThreadCount = MAXIMUM_WAIT_OBJECTS;
+    
+    auto Arena = AllocateArenaZero(64_KB);
+    
+    benchmark Benchmarks[] =
+    {
+        {"load relaxed", WorkerProc<operation::LoadRelaxed>},
+        {"load acquire", WorkerProc<operation::LoadAcquire>},
+        {"store release", WorkerProc<operation::StoreRelease>},
+        {"store seq_cst", WorkerProc<operation::StoreSequentiallyConsistent>},
+        {"fetch add", WorkerProc<operation::FetchAdd>},
+        {"compare exchange loop", WorkerProc<operation::CompareExchangeLoop>},
+    };
+    
+    LARGE_INTEGER PerformanceFrequency;
+    QueryPerformanceFrequency(&PerformanceFrequency);
+    
+    auto Stream = OpenStandardOutputStream(Arena);
+    WriteString(Stream, "% operations per thread, contended with % threads, times in ns per operation\n",
+                OperationCount, ThreadCount);
+    WriteString(Stream, "operation, uncontended, contended\n");
+    for(auto& Benchmark : Benchmarks)
+    {
+        f64 Uncontended = RunBenchmark(Arena, Benchmark, 1, OperationCount, PerformanceFrequency.QuadPart);
+        f64 Contended = RunBenchmark(Arena, Benchmark, ThreadCount, OperationCount, PerformanceFrequency.QuadPart);
+        WriteString(Stream, "%, %, %\n", Benchmark.Name, ToString(Uncontended, 2), ToString(Contended, 2));
+    }
+    Flush(Stream);
+}
@@ -1,9 +1,8 @@
+#define rstd_LeanProfile 1
 #include "shared.h"
 
 int main()
 {
-    FreeConsole();
-    
     CopyFile("last_save.txt", "save.txt", OverrideFileIfFileWithNewPathExists);
     
     auto FileStream = OpenFileStream("save.txt", io_mode::Write);
@@ -1,12 +1,12 @@
+#define rstd_LeanProfile 1
 #include "shared.h"
 
 int main()
 {
-    FreeConsole();
-    
     auto File = OpenFile("save.txt", io_mode::ReadWrite);
     RAssert(File, "Could not read \"save.txt\" file!\nWin32 error code: %", GetSystemErrorCode());
-    u32 FileSize = GetFileSize(File);
+    u64 FileSize = GetFileSize(File);
+    RAssert(FileSize != InvalidU64, "Failed to read save.txt!");
     auto EndedOn = WhatSaveFileEndedOn(File, FileSize);
     
     switch(EndedOn)
@@ -1,286 +1,858 @@
+// NOTE: Parse threads keep both buffers of their line_reader on the scratch,
+//       so it's sized for them and the scratch block isn't allocated and freed for every range
+#define rstd_ScratchArenaInitialSize MegabytesToBytes(3)
 #include "shared.h"
 
-fn IsLeapYear
-(u32 Year)
+struct formatted_time_difference
+{ u32 Hours, Minutes; };
+
+fn GetFormatedTimeDifference
+(u32 MinutesTotal)
 {
-    if(Year % 4 == 0)
-    {
-        if(Year % 100 == 0)
-            return Year % 400 == 0;
-        else
-            return true;
-    }
-    return false;
+    formatted_time_difference Res;
+    Res.Hours = MinutesTotal / 60;
+    Res.Minutes = MinutesTotal % 60;
+    return Res;
 }
 
-fn GetNumberOfDaysInMonth
-(u32 Month, u32 Year)
+// NOTE: Time is in UTC epoch seconds
+struct entry
 {
-    u32 DaysInMonth;
-    switch(Month)
+    u64 Time;
+    ended_on Type;
+};
+
+// NOTE: Calls OnEntry(Type, LocalTime) for every entry in the order of the file
+template<class on_entry> fn ReadEntries
+(line_reader& Reader, on_entry OnEntry)
+{
+    string_view Line;
+    while(ReadLine(Reader, Line))
     {
-        case 1:
-        case 3:
-        case 5:
-        case 7:
-        case 8:
-        case 10:
-        case 12:
-        DaysInMonth = 31;
-        break;
+        char* At = Line.GetCString();
+        if(*At == 0)
+            continue;
         
-        case 4:
-        case 6:
-        case 9:
-        case 11:
-        DaysInMonth = 30;
-        break;
-        
-        case 2: DaysInMonth = IsLeapYear(Year) ? 29 : 28; break;
+        ended_on Type = End;
+        if(*At == 's')
+        {
+            Type = Start;
+            At += strlen("s:");
+        }
+        else if(*At == 'e')
+        {
+            At += strlen("e:");
+        }
+        else
+        {
+            RInvalidCodePath("save.txt is corrupted!");
+        }
         
-        InvalidDefaultCase;
+        OnEntry(Type, ReadTime(&At));
     }
-    
-    return DaysInMonth;
 }
 
-constexpr u32 DaysPerWeek = 7;
-constexpr u32 SecondsPerMinute = 60;
-constexpr u32 SecondsPerHour = 60 * 60;
-constexpr u32 SecondsPerDay = 24 * SecondsPerHour;
-constexpr u32 DaysPerYear = 365;
-constexpr u32 SecondsPerYear = SecondsPerDay * DaysPerYear;
-constexpr u32 EpochYear = 1970;
-
-u32 GetSecondsSinceEpoch
-(time Time)
+// NOTE: save.txt stores local wall-clock time. It's converted to UTC with the time zone rules of each year,
+//       so chunks which contain a DST change have their real length.
+//       The time zone table is built on the first entry and is used later to split chunks into local days.
+template<class on_entry> fn ParseSaveFile
+(line_reader& Reader, arena& Arena, time_zone_table& TimeZones, on_entry OnEntry)
 {
-    const u32 MonthsInYearTable[2][12] =
-    {
-        {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31},
-        {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31}
-    };
-    
-    u32 Seconds = Time.Year * SecondsPerYear;
-    
-    u32 LeapYearCount = 0;
-    for(u32 I = 0; I < Time.Year - 1; I++)
-    {   
-        if(IsLeapYear(EpochYear + I))
-            LeapYearCount++;
-    }
-    Seconds += (LeapYearCount * SecondsPerDay);
-    
-    u32 Month = (u32)Time.Month;
-    if(Month > 1)
+    ReadEntries(Reader, [&](ended_on Type, time LocalTime)
     {
-        u32 DaysPerMonth = 0;
-        if(IsLeapYear(EpochYear + Time.Year) &&
-           (Month > 2 || (Month == 2 && Time.Day >= 29))) // only counts when we're on leap day or past it
+        if(!TimeZones.Count)
         {
-            DaysPerMonth = 1;
+            TimeBlock("Build time zone table");
+            TimeZones = BuildTimeZoneTable(Arena, LocalTime.Year, GetLocalTime().Year);
         }
-        
-        for(u32 MonthIndex = 0; MonthIndex < Month - 1; MonthIndex++)
-            Seconds += (MonthsInYearTable[DaysPerMonth][MonthIndex] * SecondsPerDay);
-    }
-    
-    Seconds += ((Time.Day - 1) * SecondsPerDay);
-    Seconds += (Time.Hour * SecondsPerHour);
-    Seconds += (Time.Minute * SecondsPerMinute);
-    Seconds += Time.Second;
-    
-    return Seconds;
+        OnEntry(entry{(u64)LocalToUtc(TimeZones, (i64)ToEpochSeconds(LocalTime)), Type});
+    });
 }
 
-fn GetTimeDifferenceInMinutes
-(time Start, time End)
+// NOTE: Ranges which are parsed in parallel share a table which was built before any of them started
+template<class on_entry> fn ParseSaveFile
+(line_reader& Reader, const time_zone_table& TimeZones, on_entry OnEntry)
 {
-    u32 StartS = GetSecondsSinceEpoch(Start);
-    u32 EndS = GetSecondsSinceEpoch(End);
-    u32 DurationInSeconds = EndS - StartS;
-    return (u32)(DurationInSeconds / SecondsPerMinute);
+    rstd_Assert(TimeZones.Count);
+    ReadEntries(Reader, [&](ended_on Type, time LocalTime)
+    { OnEntry(entry{(u64)LocalToUtc(TimeZones, (i64)ToEpochSeconds(LocalTime)), Type}); });
 }
 
-struct formatted_time_difference
-{ u32 Hours, Minutes; };
+/////////////////
+// ENTRY TABLE //
+/////////////////
+// NOTE: The report only needs the time of each entry and whether it started work,
+//       so entries are kept as an array of epoch seconds and a bit set of start entries
+struct entry_table
+{
+    dynamic_array<u64> Times;
+    dynamic_array<u64> StartBits;
+    u32 Count;
+};
 
-fn GetFormatedTimeDifference
-(u32 MinutesTotal)
+fn Init
+(entry_table& Table, arena& Arena, u32 EntryCapacity = 1024)
 {
-    formatted_time_difference Res;
-    Res.Hours = MinutesTotal / 60;
-    Res.Minutes = MinutesTotal % 60;
-    return Res;
+    Table.Times.Init(ShareArena(Arena), EntryCapacity);
+    Table.StartBits.Init(ShareArena(Arena), EntryCapacity / 64 + 1);
+    Table.Count = 0;
 }
 
-int main()
+fn Push
+(entry_table& Table, u64 Time, rstd_bool Start)
 {
-    FreeConsole();
+    if(Table.Count % 64 == 0)
+        Table.StartBits.PushZero();
+    if(Start)
+        Table.StartBits[Table.Count / 64] |= 1ull << (Table.Count % 64);
+    Table.Times.Push(Time);
+    ++Table.Count;
+}
+
+fn IsStart(entry_table& Table, u32 EntryIndex)
+{ return (rstd_bool)((Table.StartBits[EntryIndex / 64] >> (EntryIndex % 64)) & 1); }
+
+struct work_and_break
+{ u64 WorkSeconds, BreakSeconds; };
+
+// NOTE: Entries alternate between start and end so the type of a chunk depends only on the parity of its index
+fn SumWorkAndBreak
+(entry_table& Table, u64 CurrentTime)
+{
+    TimeFunction;
+    rstd_Assert(Table.Count);
+    auto Sums = SumAlternatingIntervals(Table.Times.Elements, Table.Count, CurrentTime);
     
-    auto Arena = AllocateArenaZero(2_MB);
-    char* FileContent = ReadWholeFile(Arena, "save.txt");
-    RAssert(FileContent, "Failed to read save.txt!");
+    work_and_break Res;
+    Res.WorkSeconds = IsStart(Table, 0) ? Sums.EvenSum : Sums.OddSum;
+    Res.BreakSeconds = IsStart(Table, 0) ? Sums.OddSum : Sums.EvenSum;
+    return Res;
+}
+
+// NOTE: We bill from these numbers so they're computed exactly in integers (half-up rounding)
+fn FormatTimeInHours
+(u32 TimeInMinutes)
+{ return FixedPointToString<16>(TimeInMinutes, 60, 2); }
+
+////////////////
+// DAY TOTALS //
+////////////////
+// NOTE: LocalDay counts days since 1970-01-01 in local time
+struct day_totals
+{
+    i64 LocalDay;
+    u64 WorkSeconds, BreakSeconds;
+};
+
+// NOTE: Chunks have to be added in chronological order, a chunk which crosses midnight
+//       is split between the days, and a day which has a DST change is 23 or 25 hours long
+fn AddToDays
+(bucket_array<day_totals>& Days, const time_zone_table& TimeZones, u64 Start, u64 End, rstd_bool Work)
+{
+    SplitIntoLocalDays(TimeZones, (i64)Start, (i64)End, [&](i64 LocalDay, u64 Seconds)
+    {
+        if(Days.Empty() || Days.GetLast().LocalDay != LocalDay)
+            Days.Push({LocalDay, 0, 0});
+        
+        if(Work)
+            Days.GetLast().WorkSeconds += Seconds;
+        else
+            Days.GetLast().BreakSeconds += Seconds;
+    });
+}
+
+fn AddZeroIfSingleDigit
+(u32 Number)
+{
+    string<4> Res;
+    if(Number < 10)
+        Res += '0';
+    Res += ToString(Number);
+    return Res;
+}
+
+fn FormatDate
+(i64 LocalDay)
+{
+    auto Date = CivilFromDays(LocalDay);
+    return Format<string<16>>("%-%-%", (i32)Date.Year, AddZeroIfSingleDigit(Date.Month), AddZeroIfSingleDigit(Date.Day));
+}
+
+////////////////////
+// PARALLEL PARSE //
+////////////////////
+// NOTE: save.txt is split into byte ranges which start right after a newline. Every range is parsed on
+//       the thread pool into its own entry table, day totals and sums of the chunks between its entries.
+//       Ranges are merged in order as tasks which depend on the parse of their range and the previous merge.
+//       Merging adds the chunk from the last entry of a range to the first entry of the next one
+//       and keeps only the entries the summary lists, so it doesn't grow with the file.
+//       Small files are parsed as one range without starting the thread pool.
+constexpr u64 MinBytesPerParseRange = 4_MB;
+
+// NOTE: The shortest line is "\ns:2024.1.1.1_0.0.0.0", so a range can't have more entries than its size divided by this
+constexpr u64 MinBytesPerEntry = 21;
+
+// NOTE: Days of a range take much less than its entries unless there are long gaps between entries
+constexpr u64 RangeDaysArenaSize = 64_KB;
+
+// NOTE: The summary lists only the most recent chunks and days, so the message stays short for any save.txt
+constexpr u32 SummaryChunkCount = 32;
+constexpr u32 SummaryDayCount = 14;
+
+// NOTE: Recent entries are a ring indexed by entry index, it holds the last SummaryChunkCount entries
+struct parsed_log
+{
+    u64 EntryCount;
+    u64 FirstTime;
+    u64 RecentTimes[SummaryChunkCount];
+    rstd_bool RecentStarts[SummaryChunkCount];
+    bucket_array<day_totals> Days;
+    work_and_break Totals;
+};
+
+fn PushRecentEntry
+(parsed_log& Log, u64 Time, rstd_bool Start)
+{
+    u32 Slot = (u32)(Log.EntryCount % SummaryChunkCount);
+    Log.RecentTimes[Slot] = Time;
+    Log.RecentStarts[Slot] = Start;
+    ++Log.EntryCount;
+}
+
+fn GetRecentTime(parsed_log& Log, u64 EntryIndex)
+{ return Log.RecentTimes[EntryIndex % SummaryChunkCount]; }
+
+fn IsRecentStart(parsed_log& Log, u64 EntryIndex)
+{ return Log.RecentStarts[EntryIndex % SummaryChunkCount]; }
+
+struct parse_range
+{
+    u64 Pos, EndPos;
+    const time_zone_table* TimeZones;
+    parsed_log* Log;
+    concurrent_arena* RangeArenas;
+    arena Arena;
+    entry_table Table;
+    bucket_array<day_totals> Days;
+    work_and_break Sums;
+    graph_task ParseTask, MergeTask;
+};
+
+// NOTE: The entry table gets the largest number of entries the range can have, so it never grows
+//       and the range arena can be sized for it. Range arenas are taken from one concurrent arena
+//       by the threads which parse them.
+fn ParseRange
+(parse_range& Range)
+{
+    TimeFunction;
+    u32 EntryCapacity = (u32)((Range.EndPos - Range.Pos) / MinBytesPerEntry + 1);
+    Range.Arena = SubArena(*Range.RangeArenas, EntryCapacity * sizeof(u64) + (EntryCapacity / 64 + 1) * sizeof(u64) + RangeDaysArenaSize);
+    Init(Range.Table, Range.Arena, EntryCapacity);
+    Range.Days.Init(ShareArena(Range.Arena));
     
-    struct entry
+    // NOTE: Every range has its own handle so reads of different ranges don't wait for each other.
+    //       Read buffers are on the scratch of the thread and only the entries stay in the range arena.
     {
-        time Time;
-        ended_on Type;
-    };
-    singly_linked_list<entry> Entries(ShareArena(Arena));
+        auto Scratch = GetScratch();
+        auto File = OpenFile("save.txt", io_mode::Read);
+        RAssert(File, "Failed to read save.txt!");
+        line_reader Reader;
+        Init(Reader, Scratch, File, Range.Pos, Range.EndPos);
+        Reader.OwnsFile = true;
+        ParseSaveFile(Reader, *Range.TimeZones, [&](entry Entry){ Push(Range.Table, Entry.Time, Entry.Type == Start); });
+        Close(Reader);
+    }
     
-    while(*FileContent)
+    auto& Table = Range.Table;
+    if(Table.Count)
     {
-        auto& Entry = Entries.PushUninitialized();
-        if(*FileContent == 's')
+        // NOTE: The last chunk of a range ends in the next range, so it's added during the merge.
+        //       Ranges are pool jobs already, waiting on a nested ParallelReduce could start another range on this stack.
+        u64 LastTime = Table.Times[Table.Count - 1];
+        Range.Sums = SumWorkAndBreak(Table, LastTime);
+        for(u32 EntryIndex = 0; EntryIndex + 1 < Table.Count; ++EntryIndex)
+            AddToDays(Range.Days, *Range.TimeZones, Table.Times[EntryIndex], Table.Times[EntryIndex + 1], IsStart(Table, EntryIndex));
+    }
+}
+
+// NOTE: Returns the position right after the first newline in [Pos - 1, ...), so a range which starts
+//       at the beginning of a line stays where it is. A long line is skipped and stays in the previous range.
+static task<u64> FindLineStart
+(arena& Arena, io_queue& Queue, file File, u64 Pos, u64 FileSize)
+{
+    char Buffer[DefaultMaxLineLength];
+    for(u64 ReadPos = Pos - 1; ReadPos < FileSize; ReadPos += sizeof(Buffer))
+    {
+        u32 BytesToRead = FileSize - ReadPos < sizeof(Buffer) ? (u32)(FileSize - ReadPos) : (u32)sizeof(Buffer);
+        u32 ReadBytes = co_await ReadAsync(Queue, Buffer, File, ReadPos, BytesToRead);
+        RAssert(ReadBytes == BytesToRead, "Failed to read save.txt!");
+        auto* NewLine = (char*)memchr(Buffer, '\n', ReadBytes);
+        if(NewLine)
+            co_return ReadPos + (u64)(NewLine - Buffer) + 1;
+    }
+    co_return FileSize;
+}
+
+// NOTE: A range is submitted as soon as its end is found, so the pool parses the first ranges while
+//       the later boundaries are read. Runs on the thread which called SyncWait(), frames go on its arena.
+static task<void> FindRangesAndSubmit
+(arena& Arena, io_queue& Queue, file File, u64 FileSize, parse_range* Ranges, u32 RangeCount)
+{
+    for(u32 RangeIndex = 1; RangeIndex < RangeCount; ++RangeIndex)
+    {
+        u64 Pos = co_await FindLineStart(Arena, Queue, File, FileSize * RangeIndex / RangeCount, FileSize);
+        // NOTE: Keeps every range from ending before it starts, (EndPos - Pos) sizes its arena
+        if(Pos < Ranges[RangeIndex - 1].Pos)
+            Pos = Ranges[RangeIndex - 1].Pos;
+        Ranges[RangeIndex].Pos = Pos;
+        Ranges[RangeIndex - 1].EndPos = Pos;
+        Submit(Ranges[RangeIndex - 1].ParseTask);
+    }
+    Submit(Ranges[RangeCount - 1].ParseTask);
+}
+
+// NOTE: The time zone table is shared by all ranges, so it's built from the first entry before they're parsed.
+//       Blank lines before it are skipped however many there are. The table is empty only if there are no entries.
+fn BuildTimeZoneTableFromFirstEntry
+(arena& Arena, file File, u64 FileSize)
+{
+    char Buffer[DefaultMaxLineLength + 1];
+    for(u64 Pos = 0; Pos < FileSize;)
+    {
+        u64 BytesToRead = FileSize - Pos < DefaultMaxLineLength ? FileSize - Pos : DefaultMaxLineLength;
+        RAssert(Read(Buffer, File, Pos, BytesToRead) == BytesToRead, "Failed to read save.txt!");
+        
+        u64 BlankCount = 0;
+        while(BlankCount < BytesToRead && (Buffer[BlankCount] == '\r' || Buffer[BlankCount] == '\n'))
+            ++BlankCount;
+        
+        if(BlankCount == BytesToRead)
         {
-            Entry.Type = Start;
-            FileContent += strlen("s:");
+            Pos += BytesToRead;
         }
-        else if(*FileContent == 'e')
+        else if(BlankCount)
         {
-            Entry.Type = End;
-            FileContent += strlen("e:");
+            // NOTE: The entry is read again from its start so its whole line is in the buffer
+            Pos += BlankCount;
         }
         else
         {
-            RInvalidCodePath("save.txt is corrupted!");
+            Buffer[BytesToRead] = 0;
+            char* At = Buffer + strlen("s:");
+            return BuildTimeZoneTable(Arena, ReadTime(&At).Year, GetLocalTime().Year);
         }
-        
-        Entry.Time = ReadTime(&FileContent);
-        
-        if(*FileContent == 0)
-            break;
-        
-        ++FileContent;
     }
+    return time_zone_table{};
+}
+
+fn AddChunk
+(parsed_log& Log, const time_zone_table& TimeZones, u64 Start, u64 End, rstd_bool Work)
+{
+    AddToDays(Log.Days, TimeZones, Start, End, Work);
+    if(Work)
+        Log.Totals.WorkSeconds += End - Start;
+    else
+        Log.Totals.BreakSeconds += End - Start;
+}
+
+fn Merge
+(parsed_log& Log, const time_zone_table& TimeZones, parse_range& Range)
+{
+    auto& Table = Range.Table;
+    if(!Table.Count)
+        return;
     
-    if(Entries.Empty())
-        ShowInfoMessageBoxAndCloseApp("There is nothing to show! (save.txt is empty)");
-    
-    // transform entries into chunks
-    struct chunk
+    if(Log.EntryCount)
     {
-        u32 DurationInMinutes,
-        StartHour, StartMinute,
-        EndHour, EndMinute;
-    };
-    backward_singly_linked_list_with_counter<chunk> Chunks(ShareArena(Arena));
+        u64 LastIndex = Log.EntryCount - 1;
+        AddChunk(Log, TimeZones, GetRecentTime(Log, LastIndex), Table.Times[0], IsRecentStart(Log, LastIndex));
+    }
+    else
+    {
+        Log.FirstTime = Table.Times[0];
+    }
     
-    optional<time> LastEntryTime;
-    for(auto& Entry : Entries)
+    // NOTE: Older entries of the range would be overwritten in the ring anyway, so they're only counted
+    u32 FirstKept = Table.Count > SummaryChunkCount ? Table.Count - SummaryChunkCount : 0;
+    Log.EntryCount += FirstKept;
+    for(u32 EntryIndex = FirstKept; EntryIndex < Table.Count; ++EntryIndex)
+        PushRecentEntry(Log, Table.Times[EntryIndex], IsStart(Table, EntryIndex));
+    
+    for(auto& Day : Range.Days)
     {
-        if(LastEntryTime)
+        if(!Log.Days.Empty() && Log.Days.GetLast().LocalDay == Day.LocalDay)
         {
-            auto& Chunk = Chunks.PushUninitialized();
-            Chunk.DurationInMinutes = GetTimeDifferenceInMinutes(*LastEntryTime, Entry.Time);
-            Chunk.StartHour = LastEntryTime->Hour;
-            Chunk.StartMinute = LastEntryTime->Minute;
-            Chunk.EndHour = Entry.Time.Hour;
-            Chunk.EndMinute = Entry.Time.Minute;
-            LastEntryTime = Entry.Time;
+            Log.Days.GetLast().WorkSeconds += Day.WorkSeconds;
+            Log.Days.GetLast().BreakSeconds += Day.BreakSeconds;
         }
         else
         {
-            LastEntryTime = Entry.Time;
+            Log.Days.Push(Day);
         }
     }
     
-    // add the current chunk
-    auto& LastEntry = Entries.GetLast(); 
-    time CurrentTime;
-    auto& Chunk = Chunks.PushUninitialized();
-    CurrentTime = GetLocalTime();
-    Chunk.DurationInMinutes = GetTimeDifferenceInMinutes(LastEntry.Time, CurrentTime);
-    Chunk.StartHour = LastEntry.Time.Hour;
-    Chunk.StartMinute = LastEntry.Time.Minute;
-    Chunk.EndHour = CurrentTime.Hour;
-    Chunk.EndMinute = CurrentTime.Minute;
+    Log.Totals.WorkSeconds += Range.Sums.WorkSeconds;
+    Log.Totals.BreakSeconds += Range.Sums.BreakSeconds;
+}
+
+fn ParseRangeTask(void* RangeVoidPtr)
+{ ParseRange(*(parse_range*)RangeVoidPtr); }
+
+fn MergeRangeTask
+(void* RangeVoidPtr)
+{
+    TimeFunction;
+    auto& Range = *(parse_range*)RangeVoidPtr;
+    Merge(*Range.Log, *Range.TimeZones, Range);
+}
+
+// NOTE: The last chunk ends at CurrentTime
+fn ParseSaveFileInParallel
+(arena& Arena, time_zone_table& TimeZones, u64 CurrentTime)
+{
+    TimeFunction;
+    parsed_log Log = {};
+    Log.Days.Init(ShareArena(Arena));
     
-    // calculate summary
-    time& StartTime = Entries.GetFirst().Time;
-    u32 TotalTimeInMinutes = GetTimeDifferenceInMinutes(StartTime, CurrentTime);
+    // NOTE: The file is on the queue so range boundaries can be read asynchronously
+    io_queue Queue;
+    Init(Queue);
+    auto File = OpenFile("save.txt", io_mode::Read, Queue);
+    RAssert(File, "Failed to read save.txt!");
+    u64 FileSize = GetFileSize(File);
+    RAssert(FileSize != InvalidU64, "Failed to read save.txt!");
+    
+    TimeZones = BuildTimeZoneTableFromFirstEntry(Arena, File, FileSize);
+    // NOTE: There are no entries, ranges are parsed only with a ready table
+    if(!TimeZones.Count)
+    {
+        Close(File);
+        Close(Queue);
+        return Log;
+    }
+    
+    u64 RangeCount = FileSize / MinBytesPerParseRange;
+    u32 ProcessorCount = GetLogicalProcessorCount();
+    if(RangeCount > ProcessorCount)
+        RangeCount = ProcessorCount;
+    if(RangeCount == 0)
+        RangeCount = 1;
     
-    auto MostRecentChunkIsWorkChunk = [&]()
-    { return Chunks.GetCount() % 2 == 1; };
+    // NOTE: Range arenas are bigger than a slab, so each of them is a block of its own
+    concurrent_arena RangeArenas;
+    Init(RangeArenas, RangeDaysArenaSize, RangeDaysArenaSize, "Parse ranges");
     
-    u32 WorkTimeInMinutes = TotalTimeInMinutes;
-    u32 BreakTimeInMinutes = TotalTimeInMinutes;
+    auto* Ranges = PushArrayZero(Arena, parse_range, RangeCount);
+    rstd_For(RangeIndex, (u32)RangeCount)
     {
-        bool Work = MostRecentChunkIsWorkChunk();
-        for(auto& Chunk : Chunks)
+        auto& Range = Ranges[RangeIndex];
+        Range.TimeZones = &TimeZones;
+        Range.RangeArenas = &RangeArenas;
+    }
+    Ranges[RangeCount - 1].EndPos = FileSize;
+    
+    if(RangeCount == 1)
+    {
+        ParseRange(Ranges[0]);
+        Merge(Log, TimeZones, Ranges[0]);
+    }
+    else
+    {
+        // NOTE: A range is merged as soon as it and all ranges before it are parsed, so merging runs while
+        //       the later ranges are still parsed. This thread works on the tasks too while it waits for the last merge,
+        //       so the pool has one thread less than there are ranges. The pool is on the stack,
+        //       so it's closed before we return and its threads don't outlive it.
+        thread_pool Pool;
+        Init(Pool, (u32)RangeCount - 1);
+        rstd_For(RangeIndex, (u32)RangeCount)
         {
-            if(Work)
-                BreakTimeInMinutes -= Chunk.DurationInMinutes;
-            else
-                WorkTimeInMinutes -= Chunk.DurationInMinutes;
-            Work = !Work;
+            auto& Range = Ranges[RangeIndex];
+            Range.Log = &Log;
+            Init(Range.ParseTask, Pool, &Range, ParseRangeTask);
+            Init(Range.MergeTask, Pool, &Range, MergeRangeTask);
+            AddDependency(Range.MergeTask, Range.ParseTask);
+            if(RangeIndex)
+                AddDependency(Range.MergeTask, Ranges[RangeIndex - 1].MergeTask);
         }
+        rstd_For(RangeIndex, (u32)RangeCount)
+            Submit(Ranges[RangeIndex].MergeTask);
+        SyncWait(Pool, FindRangesAndSubmit(Arena, Queue, File, FileSize, Ranges, (u32)RangeCount), &Queue);
+        Wait(Ranges[RangeCount - 1].MergeTask);
+        Close(Pool);
     }
+    Close(File);
+    Close(Queue);
     
-    // format the message
-    auto FormatHoursAndMinutes = 
-    [](formatted_time_difference Diff)
+    if(Log.EntryCount)
+    {
+        u64 LastIndex = Log.EntryCount - 1;
+        AddChunk(Log, TimeZones, GetRecentTime(Log, LastIndex), CurrentTime, IsRecentStart(Log, LastIndex));
+    }
+    
+    // NOTE: Recent entries and days of the ranges were copied into the log. Clear() frees the blocks a range arena
+    //       added when it was full and the rest goes with the concurrent arena.
+    rstd_For(RangeIndex, (u32)RangeCount)
+        Clear(Ranges[RangeIndex].Arena);
+    DeallocateArena(RangeArenas);
+    return Log;
+}
+
+////////////
+// EXPORT //
+////////////
+enum class export_format
+{ None, Csv, Json, Ndjson };
+
+struct exporter
+{
+    file_stream Stream;
+    export_format ExportFormat;
+    u32 ChunkCount;
+};
+
+template<class... args> fn Emit
+(exporter& Exporter, const char* Fmt, args... Args)
+{ WriteString(Exporter.Stream, Fmt, Args...); }
+
+fn ExportChunk
+(exporter& Exporter, u64 StartS, u64 EndS, rstd_bool Work, rstd_bool Open)
+{
+    const char* Type = Work ? "work" : "break";
+    u32 Minutes = (u32)((EndS - StartS) / SecondsPerMinute);
+    auto Hours = FormatTimeInHours(Minutes);
+    
+    switch(Exporter.ExportFormat)
+    {
+        case export_format::Csv:
+        {
+            Emit(Exporter, "chunk,%,%,%,%,%,%,\n", Type, StartS, EndS, Minutes, Hours, Open);
+        } break;
+        
+        case export_format::Json:
+        {
+            Emit(Exporter, "%{\"type\":\"%\",\"start\":%,\"end\":%,\"minutes\":%,\"hours\":%,\"open\":%}",
+                 Exporter.ChunkCount ? ",\n" : "\n", Type, StartS, EndS, Minutes, Hours, Open);
+        } break;
+        
+        case export_format::Ndjson:
+        {
+            Emit(Exporter, "{\"record\":\"chunk\",\"type\":\"%\",\"start\":%,\"end\":%,\"minutes\":%,\"hours\":%,\"open\":%}\n",
+                 Type, StartS, EndS, Minutes, Hours, Open);
+        } break;
+        
+        InvalidDefaultCase;
+    }
+    
+    ++Exporter.ChunkCount;
+}
+
+// NOTE: Start and end of a day are in UTC epoch seconds, same as chunks
+fn ExportDay
+(exporter& Exporter, time_zone_table& TimeZones, day_totals& Day, u32 DayIndex, rstd_bool Open)
+{
+    i64 StartS = LocalToUtc(TimeZones, Day.LocalDay * SecondsPerDay);
+    i64 EndS = LocalToUtc(TimeZones, (Day.LocalDay + 1) * SecondsPerDay);
+    auto Date = FormatDate(Day.LocalDay);
+    u32 WorkMinutes = (u32)(Day.WorkSeconds / SecondsPerMinute);
+    u32 BreakMinutes = (u32)(Day.BreakSeconds / SecondsPerMinute);
+    auto WorkHours = FormatTimeInHours(WorkMinutes);
+    auto BreakHours = FormatTimeInHours(BreakMinutes);
+    
+    switch(Exporter.ExportFormat)
+    {
+        case export_format::Csv:
+        {
+            Emit(Exporter, "day,work,%,%,%,%,%,%\n", StartS, EndS, WorkMinutes, WorkHours, Open, Date);
+            Emit(Exporter, "day,break,%,%,%,%,%,%\n", StartS, EndS, BreakMinutes, BreakHours, Open, Date);
+        } break;
+        
+        case export_format::Json:
+        case export_format::Ndjson:
+        {
+            if(Exporter.ExportFormat == export_format::Json)
+                Emit(Exporter, DayIndex ? ",\n{" : "\n{");
+            else
+                Emit(Exporter, "{\"record\":\"day\",");
+            Emit(Exporter, "\"date\":\"%\",\"start\":%,\"end\":%,"
+                 "\"work_minutes\":%,\"work_hours\":%,\"break_minutes\":%,\"break_hours\":%,\"open\":%}",
+                 Date, StartS, EndS, WorkMinutes, WorkHours, BreakMinutes, BreakHours, Open);
+            if(Exporter.ExportFormat == export_format::Ndjson)
+                Emit(Exporter, "\n");
+        } break;
+        
+        InvalidDefaultCase;
+    }
+}
+
+fn ExportSummary
+(exporter& Exporter, u64 StartS, u64 EndS, u32 WorkTimeInMinutes, u32 BreakTimeInMinutes, u32 TotalTimeInMinutes)
+{
+    auto WorkHours = FormatTimeInHours(WorkTimeInMinutes);
+    auto BreakHours = FormatTimeInHours(BreakTimeInMinutes);
+    auto TotalHours = FormatTimeInHours(TotalTimeInMinutes);
+    
+    switch(Exporter.ExportFormat)
+    {
+        case export_format::Csv:
+        {
+            Emit(Exporter, "summary,work,%,%,%,%,true,\n", StartS, EndS, WorkTimeInMinutes, WorkHours);
+            Emit(Exporter, "summary,break,%,%,%,%,true,\n", StartS, EndS, BreakTimeInMinutes, BreakHours);
+            Emit(Exporter, "summary,total,%,%,%,%,true,\n", StartS, EndS, TotalTimeInMinutes, TotalHours);
+        } break;
+        
+        case export_format::Json:
+        case export_format::Ndjson:
+        {
+            Emit(Exporter, Exporter.ExportFormat == export_format::Json ? ",\n\"summary\":" : "{\"record\":\"summary\",");
+            Emit(Exporter, "{\"start\":%,\"end\":%,"
+                 "\"work_minutes\":%,\"work_hours\":%,\"break_minutes\":%,\"break_hours\":%,\"total_minutes\":%,\"total_hours\":%}",
+                 StartS, EndS, WorkTimeInMinutes, WorkHours, BreakTimeInMinutes, BreakHours, TotalTimeInMinutes, TotalHours);
+            Emit(Exporter, Exporter.ExportFormat == export_format::Json ? "}\n" : "\n");
+        } break;
+        
+        InvalidDefaultCase;
+    }
+}
+
+// NOTE: Chunks are streamed in chronological order as the entries are parsed, nothing is kept per chunk.
+//       The last chunk ends now and is marked as open. Days are emitted after all chunks.
+fn Export
+(arena& Arena, line_reader& Reader, export_format ExportFormat, const char* OutputPath)
+{
+    TimeFunction;
+    exporter Exporter = {};
+    Exporter.ExportFormat = ExportFormat;
+    if(OutputPath)
+    {
+        Exporter.Stream = OpenFileStream(OutputPath, io_mode::Write, Arena);
+        RAssert(Exporter.Stream, "Failed to open \"%\"!\nWin32 error code: %", OutputPath, GetSystemErrorCode());
+    }
+    else
+    {
+        Exporter.Stream = OpenStandardOutputStream(Arena);
+        RAssert(Exporter.Stream, "Failed to open standard output!");
+    }
+    
+    if(ExportFormat == export_format::Csv)
+        Emit(Exporter, "record,type,start,end,minutes,hours,open,date\n");
+    else if(ExportFormat == export_format::Json)
+        Emit(Exporter, "{\"chunks\":[");
+    
+    time_zone_table TimeZones = {};
+    bucket_array<day_totals> Days(ShareArena(Arena));
+    optional<entry> FirstEntry, LastEntry;
+    u64 WorkChunksInSeconds = 0;
+    u64 BreakChunksInSeconds = 0;
+    auto AddChunk = [&](u64 Start, u64 End, rstd_bool Work, rstd_bool Open)
     {
-        if(Diff.Hours == 0)
-            return Format("%min", Diff.Minutes);
+        ExportChunk(Exporter, Start, End, Work, Open);
+        AddToDays(Days, TimeZones, Start, End, Work);
+        if(Work)
+            WorkChunksInSeconds += End - Start;
         else
-            return Format("%h %min", Diff.Hours, Diff.Minutes);
+            BreakChunksInSeconds += End - Start;
     };
     
-    auto FormatTime = [](u32 StartHour, u32 StartMinute, u32 EndHour, u32 EndMinute)
     {
-        auto AddZeroIfSingleDigit = [](u32 Number)
+        TimeBlock("Parse, convert and export chunks");
+        ParseSaveFile(Reader, Arena, TimeZones, [&](entry Entry)
         {
-            string<4> Res;
-            if(Number < 10)
-                Res += '0';
-            Res += ToString(Number);
-            return Res;
-        };
+            if(LastEntry)
+                AddChunk(LastEntry->Time, Entry.Time, LastEntry->Type == Start, false);
+            else
+                FirstEntry = Entry;
+            LastEntry = Entry;
+        });
+    }
+    
+    if(LastEntry)
+    {
+        u64 CurrentTime = ToEpochSeconds(GetUtcTime());
+        AddChunk(LastEntry->Time, CurrentTime, LastEntry->Type == Start, true);
         
-        return Format("%:% - %:%",
-                      AddZeroIfSingleDigit(StartHour), AddZeroIfSingleDigit(StartMinute),
-                      AddZeroIfSingleDigit(EndHour), AddZeroIfSingleDigit(EndMinute));
-    };
+        if(ExportFormat == export_format::Json)
+            Emit(Exporter, "\n],\n\"days\":[");
+        // NOTE: Only the last day contains the open chunk
+        TimeBlock("Export days and summary");
+        u32 DayIndex = 0;
+        for(auto& Day : Days)
+        {
+            ExportDay(Exporter, TimeZones, Day, DayIndex, DayIndex + 1 == Days.Count);
+            ++DayIndex;
+        }
+        if(ExportFormat == export_format::Json)
+            Emit(Exporter, "\n]");
+        
+        u32 TotalTimeInMinutes = (u32)((CurrentTime - FirstEntry->Time) / SecondsPerMinute);
+        ExportSummary(Exporter, FirstEntry->Time, CurrentTime,
+                      (u32)(WorkChunksInSeconds / SecondsPerMinute), (u32)(BreakChunksInSeconds / SecondsPerMinute),
+                      TotalTimeInMinutes);
+    }
+    else if(ExportFormat == export_format::Json)
+    {
+        Emit(Exporter, "],\n\"days\":[],\n\"summary\":null}\n");
+    }
     
-    auto FormatTimeInHours = []
-    (formatted_time_difference TimeDiff)
+    if(OutputPath)
+        Close(Exporter.Stream);
+    else
+        Flush(Exporter.Stream);
+}
+
+// NOTE: Zones are recorded only when read_timer is built with -Drstd_TimingProfilerEnabled=1
+fn WriteTrace
+(const char* TracePath)
+{
+    auto Scratch = GetScratch();
+    RAssert(WriteTimingTrace(Scratch, TracePath),
+            "Failed to write the timing trace to \"%\"!\n"
+            "read_timer has to be built with rstd_TimingProfilerEnabled defined to 1", TracePath);
+}
+
+int main
+(i32 ArgumentCount, char** Arguments)
+{
+    auto ExportFormat = export_format::None;
+    const char* OutputPath = nullptr;
+    const char* TracePath = nullptr;
+    for(i32 ArgumentIndex = 1; ArgumentIndex < ArgumentCount; ++ArgumentIndex)
     {
-        f32 TimeInHours = (f32)TimeDiff.Hours + ((f32)TimeDiff.Minutes / 60);
-        return ToString(TimeInHours, 2);
-    };
+        char* Argument = Arguments[ArgumentIndex];
+        rstd_bool HasValue = ArgumentIndex + 1 < ArgumentCount;
+        if(StringsMatch(Argument, "--format") && HasValue)
+        {
+            char* FormatName = Arguments[++ArgumentIndex];
+            if(StringsMatch(FormatName, "csv"))
+                ExportFormat = export_format::Csv;
+            else if(StringsMatch(FormatName, "json"))
+                ExportFormat = export_format::Json;
+            else if(StringsMatch(FormatName, "ndjson"))
+                ExportFormat = export_format::Ndjson;
+            else
+                RInvalidCodePath("Unknown format \"%\"! Supported formats are csv, json and ndjson", FormatName);
+        }
+        else if(StringsMatch(Argument, "--output") && HasValue)
+        {
+            OutputPath = Arguments[++ArgumentIndex];
+        }
+        else if(StringsMatch(Argument, "--trace") && HasValue)
+        {
+            TracePath = Arguments[++ArgumentIndex];
+        }
+        else
+        {
+            RInvalidCodePath("Unknown argument \"%\"!\nUsage: read_timer [--format csv|json|ndjson] [--output file] [--trace file]", Argument);
+        }
+    }
     
-    static string<8000> Message = "SUMMARY:\n";
-    auto WorkTime = GetFormatedTimeDifference(WorkTimeInMinutes);
-    auto WorkTimeInHours = FormatTimeInHours(WorkTime);
-    auto BreakTime = GetFormatedTimeDifference(BreakTimeInMinutes);
-    auto TotalTime = GetFormatedTimeDifference(TotalTimeInMinutes);
-    Message += Format
-    ("Work time: % (%h)\n"
-     "Break time: %\n"
-     "Total time: %, %\n\n",
-     FormatHoursAndMinutes(WorkTime), WorkTimeInHours,
-     FormatHoursAndMinutes(BreakTime),
-     FormatHoursAndMinutes(TotalTime),
-     FormatTime(StartTime.Hour, StartTime.Minute, CurrentTime.Hour, CurrentTime.Minute));
+    // NOTE: Exports go to stdout so the console has to stay attached
+    if(ExportFormat == export_format::None)
+        FreeConsole();
+    
+    auto Arena = AllocateArenaZero(4_MB);
+    if(ExportFormat != export_format::None)
+    {
+        line_reader Reader;
+        RAssert(OpenLineReader(Reader, Arena, "save.txt"), "Failed to read save.txt!");
+        Export(Arena, Reader, ExportFormat, OutputPath);
+        Close(Reader);
+        if(TracePath)
+            WriteTrace(TracePath);
+        return 0;
+    }
+    
+    time_zone_table TimeZones = {};
+    u64 CurrentTime = ToEpochSeconds(GetUtcTime());
+    auto Log = ParseSaveFileInParallel(Arena, TimeZones, CurrentTime);
+    auto& Days = Log.Days;
+    
+    if(Log.EntryCount == 0)
+        ShowInfoMessageBoxAndCloseApp("There is nothing to show! (save.txt is empty)");
+    
+    // calculate summary
+    u64 StartTime = Log.FirstTime;
+    u32 TotalTimeInMinutes = (u32)((CurrentTime - StartTime) / SecondsPerMinute);
+    u32 WorkTimeInMinutes = (u32)(Log.Totals.WorkSeconds / SecondsPerMinute);
+    u32 BreakTimeInMinutes = (u32)(Log.Totals.BreakSeconds / SecondsPerMinute);
     
-    Message += "CHUNKS:\n";
+    // format the message
+    static string<8000> Message = "SUMMARY:\n";
     {
-        bool Work = MostRecentChunkIsWorkChunk();
-        for(auto& Chunk : Chunks)
+        TimeBlock("Format message");
+        auto FormatHoursAndMinutes = 
+        [](formatted_time_difference Diff)
+        {
+            if(Diff.Hours == 0)
+                return Format("%min", Diff.Minutes);
+            else
+                return Format("%h %min", Diff.Hours, Diff.Minutes);
+        };
+        
+        auto FormatTime = [&](u64 Start, u64 End)
         {
-            const char* Prefix = Work ? "Work" : "Break";
-            auto TimeDiff = GetFormatedTimeDifference(Chunk.DurationInMinutes);
+            auto LocalStart = TimeFromEpochSeconds(UtcToLocal(TimeZones, (i64)Start));
+            auto LocalEnd = TimeFromEpochSeconds(UtcToLocal(TimeZones, (i64)End));
+            return Format("%:% - %:%",
+                          AddZeroIfSingleDigit(LocalStart.Hour), AddZeroIfSingleDigit(LocalStart.Minute),
+                          AddZeroIfSingleDigit(LocalEnd.Hour), AddZeroIfSingleDigit(LocalEnd.Minute));
+        };
+        
+        auto WorkTime = GetFormatedTimeDifference(WorkTimeInMinutes);
+        auto WorkTimeInHours = FormatTimeInHours(WorkTimeInMinutes);
+        auto BreakTime = GetFormatedTimeDifference(BreakTimeInMinutes);
+        auto TotalTime = GetFormatedTimeDifference(TotalTimeInMinutes);
+        Message += Format
+        ("Work time: % (%h)\n"
+         "Break time: %\n"
+         "Total time: %, %\n\n",
+         FormatHoursAndMinutes(WorkTime), WorkTimeInHours,
+         FormatHoursAndMinutes(BreakTime),
+         FormatHoursAndMinutes(TotalTime),
+         FormatTime(StartTime, CurrentTime));
+        
+        // NOTE: The most recent day goes first
+        Message += "DAYS:\n";
+        u32 ShownDayCount = 0;
+        for(auto& Day : Days.Backward())
+        {
+            if(ShownDayCount++ == SummaryDayCount)
+            {
+                Message += Format("and % older days\n", Days.Count - SummaryDayCount);
+                break;
+            }
+            
+            u32 DayWorkInMinutes = (u32)(Day.WorkSeconds / SecondsPerMinute);
+            u32 DayBreakInMinutes = (u32)(Day.BreakSeconds / SecondsPerMinute);
+            Message += Format
+            ("%: work % (%h), break %\n",
+             FormatDate(Day.LocalDay),
+             FormatHoursAndMinutes(GetFormatedTimeDifference(DayWorkInMinutes)), FormatTimeInHours(DayWorkInMinutes),
+             FormatHoursAndMinutes(GetFormatedTimeDifference(DayBreakInMinutes)));
+        }
+        Message += '\n';
+        
+        // NOTE: The most recent chunk goes first
+        Message += "CHUNKS:\n";
+        u64 FirstShownIndex = Log.EntryCount > SummaryChunkCount ? Log.EntryCount - SummaryChunkCount : 0;
+        for(u64 EntryIndex = Log.EntryCount; EntryIndex-- > FirstShownIndex;)
+        {
+            u64 ChunkStart = GetRecentTime(Log, EntryIndex);
+            u64 ChunkEnd = EntryIndex + 1 < Log.EntryCount ? GetRecentTime(Log, EntryIndex + 1) : CurrentTime;
+            u32 DurationInMinutes = (u32)((ChunkEnd - ChunkStart) / SecondsPerMinute);
+        
+            const char* Prefix = IsRecentStart(Log, EntryIndex) ? "Work" : "Break";
+            auto TimeDiff = GetFormatedTimeDifference(DurationInMinutes);
             auto HoursAndMinutes = FormatHoursAndMinutes(TimeDiff);
-            auto Hours = FormatTimeInHours(TimeDiff);
+            auto Hours = FormatTimeInHours(DurationInMinutes);
             Message += Format
             ("%: % (%h), %\n",
-             Prefix, HoursAndMinutes, Hours,
-             FormatTime(Chunk.StartHour, Chunk.StartMinute, Chunk.EndHour, Chunk.EndMinute));
-            Work = !Work;
+             Prefix, HoursAndMinutes, Hours, FormatTime(ChunkStart, ChunkEnd));
         }
+        if(FirstShownIndex)
+            Message += Format("and % older chunks\n", FirstShownIndex);
     }
     
+    if(TracePath)
+        WriteTrace(TracePath);
     ShowInfoMessageBoxAndCloseApp(Message.GetCString());
 }
@@ -32,21 +32,54 @@ Define rstd_Debug to 0 to turn off assertions and to make release only code be c
 #define rstd_MemoryProfileFunction
 #endif
 
-// TODO: Make memory profiler not suck
 #ifndef rstd_MemoryProfilerEnabled
 #define rstd_MemoryProfilerEnabled 0
 #endif
 
+// NOTE: By default the memory profiler only keeps counters per callsite
+#ifndef rstd_MemoryProfilerRecordAllocations
+#define rstd_MemoryProfilerRecordAllocations 0
+#endif
+
 #ifndef rstd_FileDebugEnabled
 #define rstd_FileDebugEnabled 0
 #endif
 
+#ifndef rstd_TimingProfilerEnabled
+#define rstd_TimingProfilerEnabled 0
+#endif
+
+// NOTE: Per worker job counters and time histograms of thread_pool, see WriteTelemetry()
+#ifndef rstd_ThreadPoolTelemetryEnabled
+#define rstd_ThreadPoolTelemetryEnabled 0
+#endif
+
+// NOTE: Has to be a power of 2
+#ifndef rstd_TimingProfilerEventsPerThread
+#define rstd_TimingProfilerEventsPerThread (64 * 1024)
+#endif
+
 #ifndef rstd_DoublyLinkedListAdvancedSanityCheckEnabled
 #define rstd_DoublyLinkedListAdvancedSanityCheckEnabled rstd_Debug
 #endif
 
+// NOTE: Profile for short lived tools which have to start fast. No background threads
+//       and no debug bookkeeping which is set up before main() runs.
+#ifndef rstd_LeanProfile
+#define rstd_LeanProfile 0
+#endif
+
+#if rstd_LeanProfile && (rstd_FileDebugEnabled || rstd_MemoryProfilerEnabled)
+#error "rstd_LeanProfile can't be used with rstd_FileDebugEnabled or rstd_MemoryProfilerEnabled"
+#endif
+
 #ifndef rstd_MultiThreadingEnabled
-#define rstd_MultiThreadingEnabled 1
+#define rstd_MultiThreadingEnabled !rstd_LeanProfile
+#endif
+
+// NOTE: rstd::task<T> coroutines, they need C++20
+#ifndef rstd_CoroutinesEnabled
+#define rstd_CoroutinesEnabled !rstd_LeanProfile
 #endif
 
 #ifndef rstd_bool
@@ -57,6 +90,10 @@ Define rstd_Debug to 0 to turn off assertions and to make release only code be c
 #include "intrin.h"
 #endif
 
+#if rstd_CoroutinesEnabled
+#include <coroutine>
+#endif
+
 namespace rstd
 {
     //////////////////////
@@ -472,6 +509,14 @@ rstd_BreakInDebugger;\
     time GetUtcTime();
     time GetLocalTime();
     
+    // NOTE: Interval i goes from Times[i] to Times[i + 1] (Times have to be sorted) and the last one is open,
+    //       it goes to OpenEnd (pass the last time if there is no open interval).
+    //       Returns the sums of the intervals which start at even and at odd indices.
+    struct alternating_interval_sums
+    { u64 EvenSum, OddSum; };
+    
+    alternating_interval_sums SumAlternatingIntervals(const u64* Times, u32 Count, u64 OpenEnd);
+    
     ////////////
     // RANDOM //
     ////////////
@@ -970,47 +1015,361 @@ view<iterator> GetView() \
     static auto ToString(i64 A)
     { return SignedIntegerToString<24>(A); }
     
-    template<u32 string_size, class float_type> static string<string_size> FloatToString
-    (float_type F, u32 Precision)
+    static constexpr u64 PowersOf10[] =
+    {
+        1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull,
+        100000000ull, 1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull,
+        10000000000000ull, 100000000000000ull, 1000000000000000ull, 10000000000000000ull,
+        100000000000000000ull, 1000000000000000000ull, 10000000000000000000ull,
+    };
+    
+    template<class string_type> static void InternalAppendScaledInteger
+    (string_type& Res, u64 Scaled, u32 Precision)
+    {
+        // NOTE: Appends Scaled / 10^Precision with exactly Precision digits after the point
+        u64 Scale = PowersOf10[Precision];
+        Res += ToString(Scaled / Scale);
+        if(Precision > 0)
+        {
+            u64 Fraction = Scaled % Scale;
+            Res += '.';
+            rstd_Assert(Res.Count + Precision <= Res.GetMaxCount());
+            size FractionBegin = Res.Count;
+            Res.Count += Precision;
+            for(u32 DigitIndex = Precision; DigitIndex > 0; --DigitIndex)
+            {
+                Res.Characters[FractionBegin + DigitIndex - 1] = DigitToChar((u32)(Fraction % 10));
+                Fraction /= 10;
+            }
+            rstd_DebugOnly(Res.InsertNullTerminator());
+        }
+    }
+    
+    // NOTE: Formats Numerator/Denominator with exactly Precision digits after the point.
+    //       Rounding is half-up and done entirely in integers, so the result is exact.
+    //       e.g. FixedPointToString<16>(Minutes, 60, 2) gives hours with 2 decimal places
+    template<u32 string_size> static string<string_size> FixedPointToString
+    (u64 Numerator, u64 Denominator, u32 Precision)
     {
+        rstd_Assert(Denominator);
+        rstd_Assert(Precision < rstd_ArrayCount(PowersOf10));
+        u64 Scale = PowersOf10[Precision];
+        rstd_AssertM(Numerator <= (MaxU64 - Denominator) / (2 * Scale), "FixedPointToString() overflow");
+        u64 Scaled = (2 * Numerator * Scale + Denominator) / (2 * Denominator);
+        
         string<string_size> Res;
+        InternalAppendScaledInteger(Res, Scaled, Precision);
+        return Res;
+    }
+    
+    namespace Grisu
+    {
+        // NOTE: Grisu2 by Florian Loitsch ("Printing Floating-Point Numbers Quickly and Accurately with Integers").
+        //       Produces the shortest (in almost all cases) digit string that reads back to the same float.
         
-        f32 Rounding = 5.f / pow(10.f, (f32)Precision + 1.f);
+        struct diy_fp
+        {
+            u64 F;
+            i32 E;
+        };
         
-        if(F < 0)
+        static diy_fp Multiply
+        (diy_fp A, diy_fp B)
         {
-            F *= -1;
-            Res += '-';
+            u64 M32 = 0xFFFFFFFF;
+            u64 AHi = A.F >> 32, ALo = A.F & M32;
+            u64 BHi = B.F >> 32, BLo = B.F & M32;
+            u64 HiHi = AHi * BHi, LoHi = ALo * BHi, HiLo = AHi * BLo, LoLo = ALo * BLo;
+            u64 Mid = (LoLo >> 32) + (HiLo & M32) + (LoHi & M32);
+            Mid += 1ull << 31; // round
+            return {HiHi + (HiLo >> 32) + (LoHi >> 32) + (Mid >> 32), A.E + B.E + 64};
         }
         
-        u64 Integer = (u64)F;
-        f64 Fraction = F - Integer + Rounding;
-        if(Fraction >= 1)
+        static diy_fp Normalize
+        (diy_fp A)
         {
-            Integer++;
-            Res += ToString(Integer);
-            Res += '.';
-            for(u32 I = 0; I < Precision; I++)
-                Res += '0';
-            return Res;
+            while(!(A.F & (1ull << 63)))
+            {
+                A.F <<= 1;
+                --A.E;
+            }
+            return A;
+        }
+        
+        static diy_fp GetCachedPower
+        (i32 E, i32* K)
+        {
+            // NOTE: 10^K for K = -348, -340, ..., 340, normalized so that the top bit of F is set
+            static const u64 CachedPowersF[] =
+            {
+                0xfa8fd5a0081c0288, 0xbaaee17fa23ebf76, 0x8b16fb203055ac76, 0xcf42894a5dce35ea,
+                0x9a6bb0aa55653b2d, 0xe61acf033d1a45df, 0xab70fe17c79ac6ca, 0xff77b1fcbebcdc4f,
+                0xbe5691ef416bd60c, 0x8dd01fad907ffc3c, 0xd3515c2831559a83, 0x9d71ac8fada6c9b5,
+                0xea9c227723ee8bcb, 0xaecc49914078536d, 0x823c12795db6ce57, 0xc21094364dfb5637,
+                0x9096ea6f3848984f, 0xd77485cb25823ac7, 0xa086cfcd97bf97f4, 0xef340a98172aace5,
+                0xb23867fb2a35b28e, 0x84c8d4dfd2c63f3b, 0xc5dd44271ad3cdba, 0x936b9fcebb25c996,
+                0xdbac6c247d62a584, 0xa3ab66580d5fdaf6, 0xf3e2f893dec3f126, 0xb5b5ada8aaff80b8,
+                0x87625f056c7c4a8b, 0xc9bcff6034c13053, 0x964e858c91ba2655, 0xdff9772470297ebd,
+                0xa6dfbd9fb8e5b88f, 0xf8a95fcf88747d94, 0xb94470938fa89bcf, 0x8a08f0f8bf0f156b,
+                0xcdb02555653131b6, 0x993fe2c6d07b7fac, 0xe45c10c42a2b3b06, 0xaa242499697392d3,
+                0xfd87b5f28300ca0e, 0xbce5086492111aeb, 0x8cbccc096f5088cc, 0xd1b71758e219652c,
+                0x9c40000000000000, 0xe8d4a51000000000, 0xad78ebc5ac620000, 0x813f3978f8940984,
+                0xc097ce7bc90715b3, 0x8f7e32ce7bea5c70, 0xd5d238a4abe98068, 0x9f4f2726179a2245,
+                0xed63a231d4c4fb27, 0xb0de65388cc8ada8, 0x83c7088e1aab65db, 0xc45d1df942711d9a,
+                0x924d692ca61be758, 0xda01ee641a708dea, 0xa26da3999aef774a, 0xf209787bb47d6b85,
+                0xb454e4a179dd1877, 0x865b86925b9bc5c2, 0xc83553c5c8965d3d, 0x952ab45cfa97a0b3,
+                0xde469fbd99a05fe3, 0xa59bc234db398c25, 0xf6c69a72a3989f5c, 0xb7dcbf5354e9bece,
+                0x88fcf317f22241e2, 0xcc20ce9bd35c78a5, 0x98165af37b2153df, 0xe2a0b5dc971f303a,
+                0xa8d9d1535ce3b396, 0xfb9b7cd9a4a7443c, 0xbb764c4ca7a44410, 0x8bab8eefb6409c1a,
+                0xd01fef10a657842c, 0x9b10a4e5e9913129, 0xe7109bfba19c0c9d, 0xac2820d9623bf429,
+                0x80444b5e7aa7cf85, 0xbf21e44003acdd2d, 0x8e679c2f5e44ff8f, 0xd433179d9c8cb841,
+                0x9e19db92b4e31ba9, 0xeb96bf6ebadf77d9, 0xaf87023b9bf0ee6b,
+            };
+            static const i16 CachedPowersE[] =
+            {
+                -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+                -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+                -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+                -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+                56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+                375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+                694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+                1013, 1039, 1066,
+            };
+            
+            // NOTE: Pick the power that brings the binary exponent into [-60, -32]
+            f64 ApproximateK = (-61 - E) * 0.30102999566398114 + 347; // ceil of this is the K we want
+            i32 CeilK = (i32)ApproximateK;
+            if(ApproximateK - CeilK > 0.0)
+                ++CeilK;
+            u32 Index = (u32)((CeilK >> 3) + 1);
+            *K = -(-348 + (i32)(Index << 3));
+            return {CachedPowersF[Index], CachedPowersE[Index]};
         }
         
-        Res += ToString(Integer);
+        static void Round
+        (char* Digits, u32 DigitCount, u64 Delta, u64 Rest, u64 TenKappa, u64 DistanceToUpper)
+        {
+            while(Rest < DistanceToUpper && Delta - Rest >= TenKappa &&
+                  (Rest + TenKappa < DistanceToUpper || DistanceToUpper - Rest > Rest + TenKappa - DistanceToUpper))
+            {
+                Digits[DigitCount - 1]--;
+                Rest += TenKappa;
+            }
+        }
         
-        if(Precision > 0)
+        static u32 GenerateDigits
+        (char* Digits, diy_fp W, diy_fp Upper, u64 Delta, i32* K)
         {
-            Res += '.';
-            while(Fraction < 0.1f && Precision > 1)
+            diy_fp One = {1ull << -Upper.E, Upper.E};
+            u64 DistanceToUpper = Upper.F - W.F;
+            u32 IntegerPart = (u32)(Upper.F >> -One.E);
+            u64 FractionPart = Upper.F & (One.F - 1);
+            
+            u32 DigitCount = 0;
+            i32 Kappa = (i32)GetDigitCount(IntegerPart);
+            while(Kappa > 0)
             {
-                Res += '0';
-                Fraction *= 10;
-                --Precision;
+                u32 Divisor = (u32)PowersOf10[Kappa - 1];
+                u32 Digit = IntegerPart / Divisor;
+                IntegerPart %= Divisor;
+                if(Digit || DigitCount)
+                    Digits[DigitCount++] = DigitToChar(Digit);
+                --Kappa;
+                
+                u64 Rest = ((u64)IntegerPart << -One.E) + FractionPart;
+                if(Rest <= Delta)
+                {
+                    *K += Kappa;
+                    Round(Digits, DigitCount, Delta, Rest, PowersOf10[Kappa] << -One.E, DistanceToUpper);
+                    return DigitCount;
+                }
             }
             
-            Fraction *= pow(10, Precision);
-            Res += ToString((u64)Fraction);
+            for(;;)
+            {
+                FractionPart *= 10;
+                Delta *= 10;
+                u32 Digit = (u32)(FractionPart >> -One.E);
+                if(Digit || DigitCount)
+                    Digits[DigitCount++] = DigitToChar(Digit);
+                FractionPart &= One.F - 1;
+                --Kappa;
+                if(FractionPart < Delta)
+                {
+                    *K += Kappa;
+                    u64 Unit = -Kappa < (i32)rstd_ArrayCount(PowersOf10) ? PowersOf10[-Kappa] : 0;
+                    Round(Digits, DigitCount, Delta, FractionPart, One.F, DistanceToUpper * Unit);
+                    return DigitCount;
+                }
+            }
+        }
+        
+        // NOTE: Value = Significand * 2^Exponent, SignificandBits doesn't include the hidden bit.
+        //       Writes up to 17 digits, value = Digits * 10^(*K)
+        static u32 ShortestDigits
+        (char* Digits, i32* K, u64 Significand, i32 Exponent, u32 SignificandBits)
+        {
+            diy_fp V = {Significand, Exponent};
+            
+            diy_fp Upper = Normalize({(V.F << 1) + 1, V.E - 1});
+            rstd_bool LowerBoundaryIsCloser = V.F == (1ull << SignificandBits);
+            diy_fp Lower = LowerBoundaryIsCloser ? diy_fp{(V.F << 2) - 1, V.E - 2} : diy_fp{(V.F << 1) - 1, V.E - 1};
+            Lower.F <<= Lower.E - Upper.E;
+            Lower.E = Upper.E;
+            
+            diy_fp CachedPower = GetCachedPower(Upper.E, K);
+            diy_fp W = Multiply(Normalize(V), CachedPower);
+            diy_fp ScaledUpper = Multiply(Upper, CachedPower);
+            diy_fp ScaledLower = Multiply(Lower, CachedPower);
+            ++ScaledLower.F;
+            --ScaledUpper.F;
+            return GenerateDigits(Digits, W, ScaledUpper, ScaledUpper.F - ScaledLower.F, K);
+        }
+    }
+    
+    template<class string_type> static void InternalAppendShortestDigits
+    (string_type& Res, const char* Digits, u32 DigitCount, i32 K)
+    {
+        // NOTE: Value = Digits * 10^K, DecimalPoint is the position of the point counting from the first digit
+        i32 DecimalPoint = (i32)DigitCount + K;
+        if(K >= 0 && DecimalPoint <= 21)
+        {
+            rstd_For(DigitIndex, DigitCount)
+                Res += Digits[DigitIndex];
+            for(i32 ZeroIndex = 0; ZeroIndex < K; ++ZeroIndex)
+                Res += '0';
+        }
+        else if(DecimalPoint > 0 && DecimalPoint <= 21)
+        {
+            rstd_For(DigitIndex, DigitCount)
+            {
+                if(DigitIndex == (u32)DecimalPoint)
+                    Res += '.';
+                Res += Digits[DigitIndex];
+            }
+        }
+        else if(DecimalPoint > -6 && DecimalPoint <= 0)
+        {
+            Res += "0.";
+            for(i32 ZeroIndex = DecimalPoint; ZeroIndex < 0; ++ZeroIndex)
+                Res += '0';
+            rstd_For(DigitIndex, DigitCount)
+                Res += Digits[DigitIndex];
+        }
+        else
+        {
+            Res += Digits[0];
+            if(DigitCount > 1)
+            {
+                Res += '.';
+                for(u32 DigitIndex = 1; DigitIndex < DigitCount; ++DigitIndex)
+                    Res += Digits[DigitIndex];
+            }
+            i32 Exponent = DecimalPoint - 1;
+            Res += 'e';
+            Res += Exponent < 0 ? '-' : '+';
+            Res += ToString((u32)(Exponent < 0 ? -Exponent : Exponent));
+        }
+    }
+    
+    // NOTE: Shortest string that reads back to exactly the same float (Grisu2)
+    template<u32 string_size, class float_type> static string<string_size> FloatToShortestString
+    (float_type F)
+    {
+        static_assert(sizeof(float_type) == 4 || sizeof(float_type) == 8);
+        constexpr u32 SignificandBits = sizeof(float_type) == 4 ? 23 : 52;
+        constexpr u32 ExponentBits = sizeof(float_type) == 4 ? 8 : 11;
+        constexpr i32 ExponentBias = (1 << (ExponentBits - 1)) - 1 + SignificandBits;
+        
+        u64 Bits;
+        if constexpr(sizeof(float_type) == 4)
+        {
+            u32 Bits32;
+            memcpy(&Bits32, &F, sizeof(F));
+            Bits = Bits32;
+        }
+        else
+        {
+            memcpy(&Bits, &F, sizeof(F));
+        }
+        
+        u64 Significand = Bits & ((1ull << SignificandBits) - 1);
+        u32 BiasedExponent = (u32)((Bits >> SignificandBits) & ((1u << ExponentBits) - 1));
+        rstd_bool Negative = (Bits >> (SignificandBits + ExponentBits)) & 1;
+        
+        string<string_size> Res;
+        if(BiasedExponent == (1u << ExponentBits) - 1)
+        {
+            if(Significand)
+                Res = "nan";
+            else
+                Res = Negative ? "-inf" : "inf";
+            return Res;
+        }
+        
+        if(Negative)
+            Res += '-';
+        
+        if(BiasedExponent == 0 && Significand == 0)
+        {
+            Res += '0';
+            return Res;
+        }
+        
+        i32 Exponent;
+        if(BiasedExponent)
+        {
+            Significand |= 1ull << SignificandBits;
+            Exponent = (i32)BiasedExponent - ExponentBias;
+        }
+        else
+        {
+            Exponent = 1 - ExponentBias;
+        }
+        
+        char Digits[20];
+        i32 K;
+        u32 DigitCount = Grisu::ShortestDigits(Digits, &K, Significand, Exponent, SignificandBits);
+        InternalAppendShortestDigits(Res, Digits, DigitCount, K);
+        return Res;
+    }
+    
+    // NOTE: Checks the exponent bits, because -fp:fast may fold comparisons like Value != Value
+    static rstd_bool IsNaNOrInfinity
+    (f64 Value)
+    {
+        u64 Bits;
+        memcpy(&Bits, &Value, sizeof(Value));
+        return ((Bits >> 52) & 0x7ff) == 0x7ff;
+    }
+    
+    template<u32 string_size, class float_type> static string<string_size> FloatToString
+    (float_type F, u32 Precision)
+    {
+        rstd_Assert(Precision < rstd_ArrayCount(PowersOf10));
+        
+        // NOTE: All the math is done in f64 (exact for f32 input) and the digits are produced from a single
+        //       rounded integer, so the output doesn't depend on pow() or on repeated multiplication by 10
+        f64 Value = (f64)F;
+        if(IsNaNOrInfinity(Value))
+            return FloatToShortestString<string_size>(F);
+        
+        string<string_size> Res;
+        if(Value < 0)
+        {
+            Value = -Value;
+            Res += '-';
         }
         
+        f64 Scaled = Value * (f64)PowersOf10[Precision] + 0.5;
+        if(Scaled >= 18446744073709551616.0) // 2^64, doesn't fit into the fixed point representation
+        {
+            Res += FloatToShortestString<string_size>(Value);
+            return Res;
+        }
+        
+        InternalAppendScaledInteger(Res, (u64)Scaled, Precision);
         return Res;
     }
     
@@ -1021,6 +1380,12 @@ view<iterator> GetView() \
     static auto ToString(f64 F, u32 Precision = 5)
     { return FloatToString<128>(F, Precision); }
     
+    static auto ToShortestString(f32 F)
+    { return FloatToShortestString<32>(F); }
+    
+    static auto ToShortestString(f64 F)
+    { return FloatToShortestString<32>(F); }
+
     template<class bool_type> static const char* BoolToString(bool_type Bool)
     { return Bool ? "true" : "false"; }
     
@@ -1696,6 +2061,9 @@ view<iterator> GetView() \
         basic_string_view(const character* CString)
             :Characters(const_cast<character*>(CString)), Count(InvalidU32) {}
         
+        basic_string_view(const character* CharactersPtr, size CharacterCount)
+            :Characters(const_cast<character*>(CharactersPtr)), Count(CharacterCount) {}
+        
         template<size Size> basic_string_view
         (const string<Size, character>& String)
             :Characters((character*)String.GetCString()), Count(String.Count) {}
@@ -1926,6 +2294,160 @@ view<iterator> GetView() \
     static time StringToTime(char* String)
     { return ReadTime(&String); }
     
+    ////////////////////////
+    // CALENDAR AND ZONES //
+    ////////////////////////
+    constexpr u32 SecondsPerMinute = 60;
+    constexpr u32 SecondsPerHour = 60 * SecondsPerMinute;
+    constexpr u32 SecondsPerDay = 24 * SecondsPerHour;
+    
+    // NOTE: Days since 1970-01-01 in the Gregorian calendar. The year is shifted to start in March
+    //       so the leap day is the last day of the year.
+    static i64 DaysFromCivil
+    (i64 Year, u32 Month, u32 Day)
+    {
+        Year -= Month <= 2;
+        i64 Era = (Year >= 0 ? Year : Year - 399) / 400;
+        u32 YearOfEra = (u32)(Year - Era * 400);
+        u32 DayOfYear = (153 * (Month > 2 ? Month - 3 : Month + 9) + 2) / 5 + Day - 1;
+        u32 DayOfEra = YearOfEra * 365 + YearOfEra / 4 - YearOfEra / 100 + DayOfYear;
+        return Era * 146097 + (i64)DayOfEra - 719468;
+    }
+    
+    struct civil_date
+    {
+        i64 Year;
+        u32 Month, Day;
+    };
+    
+    static civil_date CivilFromDays
+    (i64 Days)
+    {
+        Days += 719468;
+        i64 Era = (Days >= 0 ? Days : Days - 146096) / 146097;
+        u32 DayOfEra = (u32)(Days - Era * 146097);
+        u32 YearOfEra = (DayOfEra - DayOfEra / 1460 + DayOfEra / 36524 - DayOfEra / 146096) / 365;
+        u32 DayOfYear = DayOfEra - (365 * YearOfEra + YearOfEra / 4 - YearOfEra / 100);
+        u32 ShiftedMonth = (5 * DayOfYear + 2) / 153;
+        
+        civil_date Res;
+        Res.Day = DayOfYear - (153 * ShiftedMonth + 2) / 5 + 1;
+        Res.Month = ShiftedMonth < 10 ? ShiftedMonth + 3 : ShiftedMonth - 9;
+        Res.Year = (i64)YearOfEra + Era * 400 + (Res.Month <= 2);
+        return Res;
+    }
+    
+    static i64 FloorDiv(i64 A, i64 B)
+    { return A / B - ((A % B != 0) && ((A < 0) != (B < 0))); }
+    
+    // NOTE: Seconds since 1970-01-01 00:00 of the wall-clock time, so for local times it's local seconds
+    //       which go through LocalToUtc() to get the real epoch time
+    static u64 ToEpochSeconds
+    (time Time)
+    {
+        i64 Days = DaysFromCivil(Time.Year, (u32)Time.Month, Time.Day);
+        return (u64)(Days * SecondsPerDay + Time.Hour * SecondsPerHour + Time.Minute * SecondsPerMinute + Time.Second);
+    }
+    
+    static time TimeFromEpochSeconds
+    (i64 Seconds, u16 Millisecond = 0)
+    {
+        i64 Days = FloorDiv(Seconds, SecondsPerDay);
+        u32 SecondOfDay = (u32)(Seconds - Days * SecondsPerDay);
+        auto Date = CivilFromDays(Days);
+    
+        time Res;
+        Res.Year = (u32)Date.Year;
+        Res.Month = (month)Date.Month;
+        Res.Day = (u16)Date.Day;
+        Res.DayOfWeek = (day_of_week)((Days % 7 + 7 + 3) % 7 + 1); // NOTE: 1970-01-01 was Thursday
+        Res.Hour = (u16)(SecondOfDay / SecondsPerHour);
+        Res.Minute = (u16)(SecondOfDay / SecondsPerMinute % 60);
+        Res.Second = (u16)(SecondOfDay % 60);
+        Res.Millisecond = Millisecond;
+        return Res;
+    }
+    
+    // NOTE: Wall-clock arithmetic, so it carries into minutes, hours, days, months and years
+    //       but doesn't know about DST changes (use the time zone table for that)
+    static time AddSeconds(time Time, i64 Seconds)
+    { return TimeFromEpochSeconds((i64)ToEpochSeconds(Time) + Seconds, Time.Millisecond); }
+    
+    // NOTE: Returns End - Start in seconds, milliseconds are ignored
+    static i64 Difference(time Start, time End)
+    { return (i64)ToEpochSeconds(End) - (i64)ToEpochSeconds(Start); }
+    
+    // NOTE: Transitions[I].Offset is used from Transitions[I].UtcStart until the next transition, local = utc + offset.
+    //       The table is built once from the system time zone rules, so lookups don't touch the OS.
+    struct time_zone_transition
+    {
+        i64 UtcStart;
+        i32 OffsetInSeconds;
+    };
+    
+    struct time_zone_table
+    {
+        time_zone_transition* Transitions;
+        u32 Count;
+    };
+    
+    struct arena;
+    time_zone_table BuildTimeZoneTable(arena& Arena, u32 FirstYear, u32 LastYear);
+    
+    static i32 GetUtcOffset
+    (const time_zone_table& Table, i64 UtcSeconds)
+    {
+        rstd_Assert(Table.Count);
+        u32 Low = 0, High = Table.Count;
+        while(High - Low > 1)
+        {
+            u32 Middle = (Low + High) / 2;
+            if(Table.Transitions[Middle].UtcStart <= UtcSeconds)
+                Low = Middle;
+            else
+                High = Middle;
+        }
+        return Table.Transitions[Low].OffsetInSeconds;
+    }
+    
+    // NOTE: Local times which happen twice (when clocks go back) resolve to the earlier one
+    //       and the ones skipped when clocks go forward are moved forward by the size of the gap
+    static i64 LocalToUtc
+    (const time_zone_table& Table, i64 LocalSeconds)
+    {
+        // NOTE: Offsets are smaller than a day so these are the offsets around a transition near this time
+        i32 OffsetBefore = GetUtcOffset(Table, LocalSeconds - SecondsPerDay);
+        i32 OffsetAfter = GetUtcOffset(Table, LocalSeconds + SecondsPerDay);
+        i64 UtcBefore = LocalSeconds - OffsetBefore;
+        if(GetUtcOffset(Table, UtcBefore) == OffsetBefore)
+            return UtcBefore;
+        i64 UtcAfter = LocalSeconds - OffsetAfter;
+        if(GetUtcOffset(Table, UtcAfter) == OffsetAfter)
+            return UtcAfter;
+        return UtcBefore;
+    }
+    
+    static i64 UtcToLocal(const time_zone_table& Table, i64 UtcSeconds)
+    { return UtcSeconds + GetUtcOffset(Table, UtcSeconds); }
+    
+    // NOTE: Calls OnDay(LocalDay, Seconds) for every local day which [UtcStart, UtcEnd) overlaps,
+    //       LocalDay counts days since 1970-01-01 in local time
+    template<class on_day> static void SplitIntoLocalDays
+    (const time_zone_table& Table, i64 UtcStart, i64 UtcEnd, on_day OnDay)
+    {
+        while(UtcStart < UtcEnd)
+        {
+            i64 LocalDay = FloorDiv(UtcToLocal(Table, UtcStart), SecondsPerDay);
+            i64 NextMidnight = LocalToUtc(Table, (LocalDay + 1) * SecondsPerDay);
+            if(NextMidnight <= UtcStart)
+                NextMidnight = UtcStart + SecondsPerDay;
+            
+            i64 SegmentEnd = NextMidnight < UtcEnd ? NextMidnight : UtcEnd;
+            OnDay(LocalDay, (u64)(SegmentEnd - UtcStart));
+            UtcStart = SegmentEnd;
+        }
+    }
+    
     
     struct calling_info
     {
@@ -1998,6 +2520,9 @@ InternalPushSizeZero(_Arena, _Size, rstd_GetCallingInfo())
 #define rstd_PushStringCopy(_Arena, _InitString) \
 InternalPushStringCopy(_Arena, _InitString, rstd_GetCallingInfo())
     
+    struct file_stream;
+    struct concurrent_arena;
+    
     namespace MemoryDebug
     {
         
@@ -2031,6 +2556,11 @@ InternalPushStringCopy(_Arena, _InitString, rstd_GetCallingInfo())
         static void RegisterArenaDeallocateMemoryBlock(arena) rstd_MemoryProfilerFunctionSignature;
         static void RegisterBeginTemporaryMemory(temporary_memory TempMem) rstd_MemoryProfilerFunctionSignature;
         static void RegisterEndTemporaryMemory(temporary_memory TempMem) rstd_MemoryProfilerFunctionSignature;
+        static void RegisterCreateArena(concurrent_arena&, const char* ArenaName, calling_info) rstd_MemoryProfilerFunctionSignature;
+        static void RegisterDeallocateArena(concurrent_arena&) rstd_MemoryProfilerFunctionSignature;
+        static void RegisterArenaAllocateNextMemoryBlock(concurrent_arena&, memory_block& NewMemoryBlock) rstd_MemoryProfilerFunctionSignature;
+        static void RegisterArenaPush(concurrent_arena&, void* Memory, size Size, allocation_type, calling_info) rstd_MemoryProfilerFunctionSignature;
+        static void WriteReport(file_stream& Stream) rstd_MemoryProfilerFunctionSignature;
         
     }
     
@@ -2454,7 +2984,7 @@ InternalPushStringCopy(_Arena, _InitString, rstd_GetCallingInfo())
         { EndTemporaryMemory(TempMem); }
     };
     
-#define ScopeTemporaryMemory(Arena) scope_temporary_memory ScopeTempMem##__LINE__(Arena)
+#define ScopeTemporaryMemory(Arena) scope_temporary_memory rstd_LineName(ScopeTempMem)(Arena)
     
     
     struct arena_revert_point
@@ -2479,6 +3009,66 @@ InternalPushStringCopy(_Arena, _InitString, rstd_GetCallingInfo())
         Arena.MemoryBlock->Used = RevertPoint.Used;
     }
     
+#ifndef rstd_ScratchArenaCount
+#define rstd_ScratchArenaCount 2
+#endif
+    
+#ifndef rstd_ScratchArenaInitialSize
+#define rstd_ScratchArenaInitialSize MegabytesToBytes(1)
+#endif
+    
+    // NOTE: Every thread has its own scratch arenas, each is allocated when the thread uses it for the first time.
+    //       Everything pushed on a scratch is freed when the scratch goes out of scope.
+    //       If a function gets an arena for its result and needs a scratch too, it passes that arena
+    //       as a conflict, otherwise the result could land in the caller's scratch and get freed with it:
+    //       auto Scratch = GetScratch(&ResultArena);
+    static thread_local arena ScratchArenas[rstd_ScratchArenaCount];
+    
+    struct scratch
+    {
+        arena* Arena;
+        temporary_memory TempMem;
+        
+        scratch(arena& ScratchArena)
+            :Arena(&ScratchArena)
+            ,TempMem(BeginTemporaryMemory(ScratchArena))
+        {}
+        
+        scratch(const scratch&) = delete;
+        scratch& operator=(const scratch&) = delete;
+        
+        ~scratch()
+        { EndTemporaryMemory(TempMem); }
+        
+        operator arena&()
+        { return *Arena; }
+    };
+    
+    static scratch GetScratch
+    (arena* Conflict = nullptr, arena* OtherConflict = nullptr)
+    {
+        for(auto& Arena : ScratchArenas)
+        {
+            if(&Arena != Conflict && &Arena != OtherConflict)
+            {
+                if(!Arena.MemoryBlock)
+                    Arena = rstd_AllocateArenaZero(rstd_ScratchArenaInitialSize);
+                return scratch(Arena);
+            }
+        }
+        
+        rstd_InvalidCodePathM("All scratch arenas conflict. Define rstd_ScratchArenaCount to a bigger number");
+        return scratch(ScratchArenas[0]);
+    }
+    
+    // NOTE: Frees the scratch arenas of the calling thread, call it before a thread you created exits.
+    //       Workers of thread_pool call it themselves. No scratch of the thread may be in use.
+    static void ReleaseScratchArenas()
+    {
+        for(auto& Arena : ScratchArenas)
+            DeallocateArena(Arena);
+    }
+    
     struct arena_ref
     {
         arena_ref()
@@ -5673,61 +6263,411 @@ InternalPushStringCopy(_Arena, _InitString, rstd_GetCallingInfo())
         }
     };
     
-    /////////////////////
-    // MULTI-THREADING //
-    /////////////////////
-#ifdef _WIN32
-    static void WriteFence()
-    {
-#if rstd_MultiThreadingEnabled
-        _WriteBarrier();
-#endif
-    }
-    
-    static void ReadFence()
-    {
-#if rstd_MultiThreadingEnabled
-        _ReadBarrier();
-#endif
-    }
-    
-    static void ReadWriteFence()
-    {
-#if rstd_MultiThreadingEnabled
-        _ReadWriteBarrier();
-#endif
-    }
-    
-    u32 AtomicIncrement(volatile u32&);
-    u32 AtomicDecrement(volatile u32&);
-    
-    u64 AtomicIncrement(volatile u64&);
-    u64 AtomicDecrement(volatile u64&);
-    
-    i32 AtomicSet(volatile i32& Destination, i32 NewValue);
-    
-    u32 AtomicSet(volatile u32& Destination, u32 NewValue)
-    { return AtomicSet((volatile i32&)Destination, (i32)NewValue);}
-    
-    i32 AtomicCompareAndSet
-    (volatile i32& Destination, i32 NewValue, i32 ValueThatShouldBeInDestination);
-    
-    i64 AtomicCompareAndSet
-    (volatile i64& Destination, i64 NewValue, i64 ValueThatShouldBeInDestination);
-    
-    static u32 AtomicCompareAndSet(volatile u32& Destination, u32 NewValue, u32 ValueThatShouldBeInDestination)
-    { return (u32)AtomicCompareAndSet((volatile i32&)Destination, (i32)NewValue, (i32)ValueThatShouldBeInDestination); }
-    
-    // TODO: Do cast with assetion or use different intrinsic
-    static u64 AtomicCompareAndSet(volatile u64& Destination, u64 NewValue, u64 ValueThatShouldBeInDestination)
-    { return (u64)AtomicCompareAndSet((volatile i64&)Destination, (i64)NewValue, (i64)ValueThatShouldBeInDestination); }
-    
-    static u32 GetThreadID()
+    //////////////////
+    // BUCKET ARRAY //
+    //////////////////
+    // NOTE: Elements are stored in fixed size buckets pushed on the arena. Buckets never move so pointers to
+    //       elements stay valid, and a directory of bucket pointers gives O(1) access by index.
+    template<class type, u32 BucketSize = 256>
+        struct bucket_array
+    {
+        static_assert((BucketSize & (BucketSize - 1)) == 0, "BucketSize has to be a power of 2");
+        
+        struct bucket
+        { type Elements[BucketSize]; };
+        
+        struct iterator
+        {
+            bucket_array* Array;
+            u32 Index;
+            type* At;
+            
+            iterator& operator++()
+            {
+                ++Index;
+                if(Index & (BucketSize - 1))
+                    ++At;
+                else if(Index < Array->Count)
+                    At = Array->Directory[Index / BucketSize]->Elements;
+                return *this;
+            }
+            
+            type& operator*()
+            { return *At; }
+            
+            type* operator->()
+            { return At; }
+            
+            rstd_bool operator==(iterator Rhs)
+            { return Index == Rhs.Index; }
+            
+            rstd_bool operator!=(iterator Rhs)
+            { return Index != Rhs.Index; }
+        };
+        
+        // NOTE: Goes from the last element to the first one, End has Index == InvalidU32
+        struct backward_iterator
+        {
+            bucket_array* Array;
+            u32 Index;
+            type* At;
+            
+            backward_iterator& operator++()
+            {
+                if(Index & (BucketSize - 1))
+                    --At;
+                else if(Index != 0)
+                    At = Array->Directory[(Index - 1) / BucketSize]->Elements + (BucketSize - 1);
+                --Index;
+                return *this;
+            }
+            
+            type& operator*()
+            { return *At; }
+            
+            type* operator->()
+            { return At; }
+            
+            rstd_bool operator==(backward_iterator Rhs)
+            { return Index == Rhs.Index; }
+            
+            rstd_bool operator!=(backward_iterator Rhs)
+            { return Index != Rhs.Index; }
+        };
+        
+        bucket** Directory;
+        u32 DirectoryCapacity;
+        u32 BucketCount;
+        u32 Count;
+        arena_ref ArenaRef;
+        
+        rstd_bool Initialized()
+        { return ArenaRef; }
+        
+        void Init
+        (arena_ref _ArenaRef)
+        {
+            ArenaRef = _ArenaRef;
+            Directory = nullptr;
+            DirectoryCapacity = BucketCount = Count = 0;
+        }
+        
+        bucket_array(arena_ref ArenaRef)
+        { Init(ArenaRef); }
+        
+#ifdef rstd_DefaultArena
+        bucket_array()
+        { Init(ShareArena(DefaultArena)); }
+#else
+        bucket_array()
+        { Init(arena_ref()); }
+#endif
+        
+        iterator Begin()
+        { return {this, 0, Count ? Directory[0]->Elements : nullptr}; }
+        
+        iterator End()
+        { return {this, Count, nullptr}; }
+        
+        internal_rstd_RestOfIteratorFunctions;
+        
+        backward_iterator BackwardBegin()
+        { return {this, Count - 1, Count ? &(*this)[Count - 1] : nullptr}; }
+        
+        backward_iterator BackwardEnd()
+        { return {this, InvalidU32, nullptr}; }
+        
+        view<backward_iterator> Backward()
+        { return {BackwardBegin(), BackwardEnd()}; }
+        
+        type GetVariableOfElementType()
+        { return Directory[0]->Elements[0]; }
+        
+        type& operator[]
+        (u32 Index)
+        {
+            rstd_AssertM(Index < Count,
+                         "You tried to get element [%], but this bucket_array has only % elements", Index, Count);
+            return Directory[Index / BucketSize]->Elements[Index & (BucketSize - 1)];
+        }
+        
+        type& GetFirst()
+        {
+            rstd_Assert(!Empty());
+            return (*this)[0];
+        }
+        
+        type& GetLast()
+        {
+            rstd_Assert(!Empty());
+            return (*this)[Count - 1];
+        }
+        
+        rstd_bool Empty()
+        { return Count == 0; }
+        
+        u32 GetCount()
+        { return Count; }
+        
+        // NOTE: Buckets are kept and reused by next pushes
+        void Clear()
+        { Count = 0; }
+        
+        void InternalAddBucket()
+        {
+            rstd_Assert(ArenaRef);
+            if(BucketCount == DirectoryCapacity)
+            {
+                u32 NewCapacity = DirectoryCapacity ? DirectoryCapacity * 2 : 8;
+                auto** NewDirectory = rstd_PushArrayUninitialized(*ArenaRef, bucket*, NewCapacity);
+                if(BucketCount)
+                    memcpy(NewDirectory, Directory, BucketCount * sizeof(bucket*));
+                Directory = NewDirectory;
+                DirectoryCapacity = NewCapacity;
+            }
+            Directory[BucketCount++] = &rstd_PushStructUninitialized(*ArenaRef, bucket);
+        }
+        
+        type& PushUninitialized()
+        {
+            if(Count == BucketCount * BucketSize)
+                InternalAddBucket();
+            u32 Index = Count++;
+            return Directory[Index / BucketSize]->Elements[Index & (BucketSize - 1)];
+        }
+        
+        type& PushZero()
+        { return PushUninitialized() = {}; }
+        
+        type& Push
+        (const type& InitialData)
+        {
+            auto& Data = PushUninitialized();
+            Data = InitialData;
+            return Data;
+        }
+        
+        void Pop()
+        {
+            rstd_Assert(!Empty());
+            --Count;
+        }
+    };
+    
+    /////////////////////
+    // MULTI-THREADING //
+    /////////////////////
+    // NOTE: Atomics with explicit memory order on 4 and 8 byte integers and pointers, Order is a template parameter
+    //       so it costs nothing at runtime. MSVC uses Interlocked intrinsics, which are full barriers on x64 anyway,
+    //       and plain volatile loads and stores with compiler barriers. GCC and Clang use __atomic builtins.
+    //       With rstd_MultiThreadingEnabled 0 they are ordinary reads and writes.
+    //       AtomicFetchAdd(), AtomicExchange() and AtomicCompareExchange() return the value from before the operation.
+    enum class memory_order
+    {
+        Relaxed,
+        Acquire,
+        Release,
+        AcquireRelease,
+        SequentiallyConsistent,
+    };
+    
+#if rstd_MultiThreadingEnabled && !defined(_MSC_VER)
+    constexpr int InternalGetBuiltinMemoryOrder(memory_order Order)
+    {
+        return Order == memory_order::Relaxed ? __ATOMIC_RELAXED :
+            Order == memory_order::Acquire ? __ATOMIC_ACQUIRE :
+            Order == memory_order::Release ? __ATOMIC_RELEASE :
+            Order == memory_order::AcquireRelease ? __ATOMIC_ACQ_REL : __ATOMIC_SEQ_CST;
+    }
+#endif
+    
+    template<class type> constexpr rstd_bool InternalIsAtomicType()
+    { return sizeof(type) == 4 || sizeof(type) == 8; }
+    
+    // NOTE: Type of an atomic is taken only from the destination, so AtomicStore(U32, 0) works
+    template<class type> struct internal_atomic_value
+    { using value = type; };
+    
+    template<memory_order Order = memory_order::SequentiallyConsistent, class type> static type AtomicLoad
+    (const volatile type& Source)
+    {
+        static_assert(InternalIsAtomicType<type>(), "Atomics work on 4 and 8 byte types");
+        static_assert(Order != memory_order::Release && Order != memory_order::AcquireRelease, "Invalid order for a load");
+#if !rstd_MultiThreadingEnabled
+        return Source;
+#elif defined(_MSC_VER)
+        type Value = Source;
+        if constexpr(Order != memory_order::Relaxed)
+            _ReadWriteBarrier();
+        return Value;
+#else
+        return __atomic_load_n(&Source, InternalGetBuiltinMemoryOrder(Order));
+#endif
+    }
+    
+    template<memory_order Order = memory_order::SequentiallyConsistent, class type> static void AtomicStore
+    (volatile type& Destination, typename internal_atomic_value<type>::value Value)
+    {
+        static_assert(InternalIsAtomicType<type>(), "Atomics work on 4 and 8 byte types");
+        static_assert(Order != memory_order::Acquire && Order != memory_order::AcquireRelease, "Invalid order for a store");
+#if !rstd_MultiThreadingEnabled
+        Destination = Value;
+#elif defined(_MSC_VER)
+        if constexpr(Order == memory_order::SequentiallyConsistent)
+        {
+            if constexpr(sizeof(type) == 8)
+                _InterlockedExchange64((volatile long long*)&Destination, (long long)Value);
+            else
+                _InterlockedExchange((volatile long*)&Destination, (long)Value);
+        }
+        else
+        {
+            if constexpr(Order == memory_order::Release)
+                _ReadWriteBarrier();
+            Destination = Value;
+        }
+#else
+        __atomic_store_n(&Destination, Value, InternalGetBuiltinMemoryOrder(Order));
+#endif
+    }
+    
+    template<memory_order Order = memory_order::SequentiallyConsistent, class type> static type AtomicExchange
+    (volatile type& Destination, typename internal_atomic_value<type>::value Value)
+    {
+        static_assert(InternalIsAtomicType<type>(), "Atomics work on 4 and 8 byte types");
+#if !rstd_MultiThreadingEnabled
+        type Previous = Destination;
+        Destination = Value;
+        return Previous;
+#elif defined(_MSC_VER)
+        if constexpr(sizeof(type) == 8)
+            return (type)_InterlockedExchange64((volatile long long*)&Destination, (long long)Value);
+        else
+            return (type)_InterlockedExchange((volatile long*)&Destination, (long)Value);
+#else
+        return __atomic_exchange_n(&Destination, Value, InternalGetBuiltinMemoryOrder(Order));
+#endif
+    }
+    
+    template<memory_order Order = memory_order::SequentiallyConsistent, class type> static type AtomicFetchAdd
+    (volatile type& Destination, typename internal_atomic_value<type>::value Value)
+    {
+        static_assert(InternalIsAtomicType<type>(), "Atomics work on 4 and 8 byte types");
+#if !rstd_MultiThreadingEnabled
+        type Previous = Destination;
+        Destination += Value;
+        return Previous;
+#elif defined(_MSC_VER)
+        if constexpr(sizeof(type) == 8)
+            return (type)_InterlockedExchangeAdd64((volatile long long*)&Destination, (long long)Value);
+        else
+            return (type)_InterlockedExchangeAdd((volatile long*)&Destination, (long)Value);
+#else
+        return __atomic_fetch_add(&Destination, Value, InternalGetBuiltinMemoryOrder(Order));
+#endif
+    }
+    
+    // NOTE: Destination is set to Desired only if it was Expected. Order is used when it succeeds,
+    //       a failed compare is only a load, so it uses Acquire or Relaxed.
+    template<memory_order Order = memory_order::SequentiallyConsistent, class type> static type AtomicCompareExchange
+    (volatile type& Destination, typename internal_atomic_value<type>::value Desired,
+     typename internal_atomic_value<type>::value Expected)
+    {
+        static_assert(InternalIsAtomicType<type>(), "Atomics work on 4 and 8 byte types");
+#if !rstd_MultiThreadingEnabled
+        type Previous = Destination;
+        if(Previous == Expected)
+            Destination = Desired;
+        return Previous;
+#elif defined(_MSC_VER)
+        if constexpr(sizeof(type) == 8)
+            return (type)_InterlockedCompareExchange64((volatile long long*)&Destination, (long long)Desired, (long long)Expected);
+        else
+            return (type)_InterlockedCompareExchange((volatile long*)&Destination, (long)Desired, (long)Expected);
+#else
+        constexpr memory_order FailureOrder = Order == memory_order::Relaxed || Order == memory_order::Release ?
+            memory_order::Relaxed : memory_order::Acquire;
+        __atomic_compare_exchange_n(&Destination, &Expected, Desired, false,
+                                    InternalGetBuiltinMemoryOrder(Order), InternalGetBuiltinMemoryOrder(FailureOrder));
+        return Expected;
+#endif
+    }
+    
+    // NOTE: These are sequentially consistent
+    static u32 AtomicIncrement(volatile u32& A)
+    { return AtomicFetchAdd(A, 1u) + 1; }
+    
+    static u32 AtomicDecrement(volatile u32& A)
+    { return AtomicFetchAdd(A, (u32)-1) - 1; }
+    
+    static u64 AtomicIncrement(volatile u64& A)
+    { return AtomicFetchAdd(A, (u64)1) + 1; }
+    
+    static u64 AtomicDecrement(volatile u64& A)
+    { return AtomicFetchAdd(A, (u64)-1) - 1; }
+    
+    // NOTE: Returns the value which was in Destination before the addition
+    static u64 AtomicAdd(volatile u64& Destination, u64 Value)
+    { return AtomicFetchAdd(Destination, Value); }
+    
+    static i32 AtomicSet(volatile i32& Destination, i32 NewValue)
+    { return AtomicExchange(Destination, NewValue); }
+    
+    static u32 AtomicSet(volatile u32& Destination, u32 NewValue)
+    { return AtomicExchange(Destination, NewValue); }
+    
+    // NOTE: Returns the value which was in Destination, it was set only if that is ValueThatShouldBeInDestination
+    template<class type> static type AtomicCompareAndSet
+    (volatile type& Destination, typename internal_atomic_value<type>::value NewValue,
+     typename internal_atomic_value<type>::value ValueThatShouldBeInDestination)
+    { return AtomicCompareExchange(Destination, NewValue, ValueThatShouldBeInDestination); }
+    
+    // NOTE: Prefer AtomicStore<memory_order::Release>() and AtomicLoad<memory_order::Acquire>() on the flag or pointer
+    //       which publishes the data. On MSVC these are only compiler barriers, which is enough on x64.
+    static void WriteFence()
+    {
+#if rstd_MultiThreadingEnabled && defined(_MSC_VER)
+        _WriteBarrier();
+#elif rstd_MultiThreadingEnabled
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+#endif
+    }
+    
+    static void ReadFence()
+    {
+#if rstd_MultiThreadingEnabled && defined(_MSC_VER)
+        _ReadBarrier();
+#elif rstd_MultiThreadingEnabled
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+#endif
+    }
+    
+    static void ReadWriteFence()
+    {
+#if rstd_MultiThreadingEnabled && defined(_MSC_VER)
+        _ReadWriteBarrier();
+#elif rstd_MultiThreadingEnabled
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+    }
+    
+#ifdef _WIN32
+    static u32 GetThreadID()
     {
         u8 *ThreadLocalStorage = (u8 *)__readgsqword(0x30);
         return *(u32*)(ThreadLocalStorage + 0x48);
     }
+#else
+    static volatile u32 InternalNextThreadID;
+    static thread_local u32 InternalThreadID;
     
+    // NOTE: Ids are given out in the order in which threads first ask for them, they aren't the ids of the OS
+    static u32 GetThreadID()
+    {
+        if(!InternalThreadID)
+            InternalThreadID = AtomicIncrement(InternalNextThreadID);
+        return InternalThreadID;
+    }
 #endif
     
     struct mutex
@@ -5737,7 +6677,8 @@ InternalPushStringCopy(_Arena, _InitString, rstd_GetCallingInfo())
     (volatile i32& Locked)
     {
 #if rstd_MultiThreadingEnabled
-        while(Locked || AtomicCompareAndSet(Locked, 1, 0) != 0);
+        while(AtomicLoad<memory_order::Relaxed>(Locked) ||
+              AtomicCompareExchange<memory_order::Acquire>(Locked, 1, 0) != 0);
 #endif
     }
     
@@ -5748,7 +6689,8 @@ InternalPushStringCopy(_Arena, _InitString, rstd_GetCallingInfo())
     (volatile i32& Locked)
     {
 #if rstd_MultiThreadingEnabled
-        return !Locked && AtomicCompareAndSet(Locked, 1, 0) == 0;
+        return !AtomicLoad<memory_order::Relaxed>(Locked) &&
+            AtomicCompareExchange<memory_order::Acquire>(Locked, 1, 0) == 0;
 #else
         return true;
 #endif
@@ -5761,7 +6703,7 @@ InternalPushStringCopy(_Arena, _InitString, rstd_GetCallingInfo())
     (volatile i32& Locked)
     {
 #if rstd_MultiThreadingEnabled
-        Locked = 0;
+        AtomicStore<memory_order::Release>(Locked, 0);
 #endif
     }
     
@@ -5772,39 +6714,383 @@ InternalPushStringCopy(_Arena, _InitString, rstd_GetCallingInfo())
 rstd::Lock(_Mutex); \
 rstd_defer(rstd::Unlock(_Mutex)); \
     
+#ifndef rstd_ConcurrentArenaSlabSize
+#define rstd_ConcurrentArenaSlabSize KilobytesToBytes(64)
+#endif
+    
+    // NOTE: Arena which many threads can push on at the same time. Blocks are chained like in arena.
+    //       Used of the current block is a reservation cursor: a thread takes a slab from it with one atomic add
+    //       and then pushes inside the slab without any synchronization. Only adding a block takes a lock.
+    //       Pushes bigger than a slab get their own block. Used can go past Size when the block is full.
+    //       Memory always comes from fresh OS pages, so it's zero and PushSizeZero doesn't have to clear it.
+    struct concurrent_arena
+    {
+        memory_block* volatile MemoryBlock;
+        size MinimalAllocationSize;
+        size SlabSize;
+        u64 Id; // NOTE: Changes on Clear() so slabs taken before are dropped
+        mutex GrowMutex;
+        rstd_DebugOnly(const char* DebugName;)
+    };
+    
+    struct concurrent_arena_slab
+    {
+        u64 ArenaId;
+        u8* At;
+        u8* End;
+    };
+    
+    // NOTE: A thread keeps slabs of the few arenas it pushed on most recently
+    constexpr u32 ConcurrentArenaSlabsPerThread = 4;
+    static thread_local concurrent_arena_slab ConcurrentArenaSlabs[ConcurrentArenaSlabsPerThread];
+    static thread_local u32 NextConcurrentArenaSlabToReplace;
+    static volatile u64 NextConcurrentArenaId;
+    
+    static memory_block* InternalAllocateConcurrentArenaBlock
+    (size Size, memory_block* Prev)
+    {
+        size AllocationSize = Align(Size + sizeof(memory_block), MemoryPageSize);
+        u8* Base = (u8*)PageAlloc(AllocationSize);
+        rstd_RAssert(Base, "OS Allocation call failed (probably your machine ran out of memory)");
+        
+        auto* MemBlock = (memory_block*)(Base + AllocationSize - sizeof(memory_block));
+        MemBlock->Prev = Prev;
+        MemBlock->Base = Base;
+        MemBlock->Used = 0;
+        MemBlock->MaxHistoricalUsed = 0;
+        MemBlock->Size = AllocationSize - sizeof(memory_block);
+        return MemBlock;
+    }
+    
+    static void Init
+    (concurrent_arena& Arena, size InitialSize = MegabytesToBytes(1), size SlabSize = rstd_ConcurrentArenaSlabSize,
+     const char* DebugName = nullptr)
+    {
+        rstd_AssertM(SlabSize <= InitialSize, "Slab has to fit in a block");
+        Arena = {};
+        Arena.MinimalAllocationSize = InitialSize;
+        Arena.SlabSize = SlabSize;
+        Arena.Id = AtomicIncrement(NextConcurrentArenaId);
+        Arena.MemoryBlock = InternalAllocateConcurrentArenaBlock(InitialSize, nullptr);
+        MemoryDebug::RegisterCreateArena(Arena, DebugName, rstd_GetCallingInfo());
+    }
+    
+    static void InternalAddBlock
+    (concurrent_arena& Arena, memory_block* FullBlock)
+    {
+        rstd_ScopeLock(Arena.GrowMutex);
+        if(Arena.MemoryBlock != FullBlock)
+            return; // NOTE: Other thread already added a block
+        
+        auto* NewBlock = InternalAllocateConcurrentArenaBlock(Arena.MinimalAllocationSize, FullBlock);
+        MemoryDebug::RegisterArenaAllocateNextMemoryBlock(Arena, *NewBlock);
+        AtomicStore<memory_order::Release>(Arena.MemoryBlock, NewBlock);
+    }
+    
+    // NOTE: The block is put behind the current one, so the current block can still be used for slabs
+    static u8* InternalPushOwnBlock
+    (concurrent_arena& Arena, size Size)
+    {
+        rstd_ScopeLock(Arena.GrowMutex);
+        auto* CurrentBlock = Arena.MemoryBlock;
+        auto* NewBlock = InternalAllocateConcurrentArenaBlock(Size, CurrentBlock->Prev);
+        NewBlock->Used = Size;
+        CurrentBlock->Prev = NewBlock;
+        MemoryDebug::RegisterArenaAllocateNextMemoryBlock(Arena, *NewBlock);
+        return NewBlock->Base;
+    }
+    
+    static u8* InternalReserve
+    (concurrent_arena& Arena, size Size)
+    {
+        for(;;)
+        {
+            auto* MemBlock = AtomicLoad<memory_order::Acquire>(Arena.MemoryBlock);
+            u64 Begin = AtomicAdd(*(volatile u64*)&MemBlock->Used, (u64)Size);
+            if(Begin + Size <= MemBlock->Size)
+                return MemBlock->Base + Begin;
+            InternalAddBlock(Arena, MemBlock);
+        }
+    }
+    
+    static concurrent_arena_slab& InternalGetSlab
+    (concurrent_arena& Arena)
+    {
+        for(auto& Slab : ConcurrentArenaSlabs)
+        {
+            if(Slab.ArenaId == Arena.Id)
+                return Slab;
+        }
+        
+        auto& Slab = ConcurrentArenaSlabs[NextConcurrentArenaSlabToReplace++ % ConcurrentArenaSlabsPerThread];
+        Slab = {Arena.Id, nullptr, nullptr};
+        return Slab;
+    }
+    
+    // NOTE: Pushes are aligned to 8 bytes, so results of different threads don't share a word
+    static u8* InternalPush
+    (concurrent_arena& Arena, size Size)
+    {
+        Size = Align(Size, 8);
+        if(Size > Arena.SlabSize)
+            return InternalPushOwnBlock(Arena, Size);
+        
+        auto& Slab = InternalGetSlab(Arena);
+        if((size)(Slab.End - Slab.At) < Size)
+        {
+            Slab.At = InternalReserve(Arena, Arena.SlabSize);
+            Slab.End = Slab.At + Arena.SlabSize;
+        }
+        
+        u8* Res = Slab.At;
+        Slab.At += Size;
+        return Res;
+    }
+    
+    static u8* InternalPushSizeUninitialized
+    (concurrent_arena& Arena, size Size, calling_info CallingInfo)
+    {
+        u8* Res = InternalPush(Arena, Size);
+        MemoryDebug::RegisterArenaPush(Arena, Res, Size, MemoryDebug::allocation_type::ArenaPushUninitialized, CallingInfo);
+        return Res;
+    }
+    
+    static u8* InternalPushSizeZero
+    (concurrent_arena& Arena, size Size, calling_info CallingInfo)
+    {
+        u8* Res = InternalPush(Arena, Size);
+        MemoryDebug::RegisterArenaPush(Arena, Res, Size, MemoryDebug::allocation_type::ArenaPushZero, CallingInfo);
+        return Res;
+    }
+    
+    // NOTE: Clear() and DeallocateArena() can't run while other threads push
+    static void DeallocateArena
+    (concurrent_arena& Arena)
+    {
+        MemoryDebug::RegisterDeallocateArena(Arena);
+        auto* MemBlock = Arena.MemoryBlock;
+        while(MemBlock)
+        {
+            auto* PrevMemBlock = MemBlock->Prev;
+            PageFree(MemBlock->Base);
+            MemBlock = PrevMemBlock;
+        }
+        Arena.MemoryBlock = nullptr;
+    }
+    
+    static void Clear
+    (concurrent_arena& Arena)
+    {
+        DeallocateArena(Arena);
+        Arena.Id = AtomicIncrement(NextConcurrentArenaId);
+        Arena.MemoryBlock = InternalAllocateConcurrentArenaBlock(Arena.MinimalAllocationSize, nullptr);
+#if rstd_Debug
+        MemoryDebug::RegisterCreateArena(Arena, Arena.DebugName, rstd_GetCallingInfo());
+#endif
+    }
+    
+    // NOTE: Any thread can take a sub arena, then only one thread at a time pushes on it like on any arena.
+    //       Blocks it adds when it's full come from the OS and not from the master arena.
+    static arena InternalSubArena
+    (concurrent_arena& MasterArena, size Size, calling_info CallingInfo, const char* DebugName = nullptr)
+    {
+        arena SubArena;
+        
+        Size = Align(Size, 8);
+        u8* Base = InternalPushSizeUninitialized(MasterArena, Size + sizeof(memory_block), CallingInfo);
+        
+        memory_block* MemBlock = (memory_block*)(Base + Size);
+        ZeroOutStruct(*MemBlock);
+        MemBlock->Base = Base;
+        MemBlock->Size = Size;
+        SubArena.MemoryBlock = MemBlock;
+        
+        SubArena.MinimalAllocationSize = MasterArena.MinimalAllocationSize;
+        SubArena.TempMemCount = 0;
+        
+#if rstd_Debug
+        MemoryDebug::RegisterCreateArena(SubArena, DebugName, MasterArena.DebugName, CallingInfo);
+#endif
+        
+        return SubArena;
+    }
+    
     struct thread_pool;
     
     typedef void thread_pool_job_callback(void* Data);
     
+    // NOTE: FinishedFlag is set when the job has left the pool, after its callback and after PendingJobCount.
+    //       The waiter can free everything the job used then, only the pool itself has to stay until Close().
     struct thread_pool_job
     {
         void* CallbackUserData;
         thread_pool_job_callback* Callback;
+        volatile u32* FinishedFlag;
+#if rstd_ThreadPoolTelemetryEnabled
+        u64 PushTsc;
+#endif
     };
     
-    struct thread_pool_job_node : thread_pool_job
-    { thread_pool_job_node* Next; };
+#ifndef rstd_ThreadPoolQueueSize
+#define rstd_ThreadPoolQueueSize 4096
+#endif
+    
+#ifndef rstd_ThreadPoolHighPriorityQueueSize
+#define rstd_ThreadPoolHighPriorityQueueSize 256
+#endif
+    
+#ifndef rstd_ThreadPoolMaxThreadCount
+#define rstd_ThreadPoolMaxThreadCount 256
+#endif
+    
+#ifndef rstd_TaskMaxContinuations
+#define rstd_TaskMaxContinuations 16
+#endif
     
-    struct thread_pool_job_list
+    // NOTE: Bounded lock-free queue for many producers and many consumers (Dmitry Vyukov's design).
+    //       Sequence of a cell tells whose turn it is: it equals the position when the cell is free
+    //       for a producer and the position + 1 when it holds a job for a consumer.
+    struct thread_pool_job_cell
     {
-        thread_pool_job_node* NextJobToTake;
-        thread_pool_job_node* LastJobToTake;
-        thread_pool_job_node* JobFreeList;
-        arena Arena;
-        mutex Mutex;
+        volatile u64 Sequence;
+        thread_pool_job Job;
+    };
+    
+    struct thread_pool_job_queue
+    {
+        thread_pool_job_cell* Cells;
+        u64 Mask;
+        alignas(64) volatile u64 EnqueuePos;
+        alignas(64) volatile u64 DequeuePos;
+    };
+    
+    // NOTE: Threads take high priority jobs first, so a short interactive job doesn't wait behind bulk work.
+    //       It doesn't preempt jobs which are already running.
+    enum class job_priority
+    {
+        Normal,
+        High,
+    };
+    
+    // NOTE: Core pins worker N to logical processor N (modulo processor count, across processor groups).
+    //       NumaNode lets worker N run on any processor of NUMA node N (modulo node count).
+    enum class thread_affinity
+    {
+        Any,
+        Core,
+        NumaNode,
+    };
+    
+    constexpr u32 ThreadPoolHistogramBucketCount = 32;
+    
+    // NOTE: Times are in rdtsc ticks. Bucket N of a histogram counts times from 2^N to 2^(N+1) ticks,
+    //       the last bucket counts all longer times too. Only the worker writes its own telemetry,
+    //       so it can be read at any time without locks, the numbers just don't have to be from the same moment.
+    struct thread_pool_telemetry
+    {
+        volatile u64 JobCount;
+        volatile u64 QueueWaitTicks;
+        volatile u64 RunTicks;
+        volatile u64 IdleTicks;
+        volatile u64 QueueWaitHistogram[ThreadPoolHistogramBucketCount];
+        volatile u64 RunHistogram[ThreadPoolHistogramBucketCount];
+    };
+    
+    // NOTE: Telemetry stays in the worker slot when SetThreadCount() stops the thread
+    struct thread_pool_worker
+    {
+        thread_pool* Pool;
+        void* ThreadHandle;
+        u32 Index;
+#if rstd_ThreadPoolTelemetryEnabled
+        alignas(64) thread_pool_telemetry Telemetry;
+#endif
     };
     
+    // NOTE: PendingJobCount counts jobs from PushJob() until their callback returns.
+    //       When the queue is full PushJob() runs queued jobs on the pushing thread until a cell frees up.
+    //       A worker whose Index isn't smaller than ThreadCount exits after its current job.
+    //       SleepingThreadCount counts workers which wait on the semaphore and nobody has woken up yet,
+    //       whoever releases the semaphore takes them from it first, so it's never released more than needed.
     struct thread_pool
     {
-        thread_pool_job_list JobList;
-        volatile u32 RunningJobCount;
+        thread_pool_job_queue Queue;
+        thread_pool_job_queue HighPriorityQueue;
+        alignas(64) volatile u32 PendingJobCount;
+        volatile u32 SleepingThreadCount;
         void* SemaphoreHandle;
-        u32 ThreadCount;
+        volatile u32 ThreadCount;
+        thread_affinity Affinity;
+        mutex ResizeMutex;
+        thread_pool_worker Workers[rstd_ThreadPoolMaxThreadCount];
+#if rstd_ThreadPoolTelemetryEnabled
+        // NOTE: Jobs run by threads which aren't workers of this pool: CompleteAllJobs(), Wait(),
+        //       a full queue in PushJob(). Many threads write here, so it's updated with atomics.
+        alignas(64) thread_pool_telemetry HelperTelemetry;
+        u64 TelemetryStartTsc;
+        i64 TelemetryStartPerformanceCounter;
+#endif
     };
     
-    void Init(thread_pool& Pool, u32 ThreadCount, arena ArenaResponsibleOnlyForAllocatingJobs);
-    void PushJob(thread_pool&, void* JobUserData, thread_pool_job_callback* JobCallback);
+    // NOTE: QueueSize has to be a power of 2
+    void Init(thread_pool& Pool, u32 ThreadCount, u32 QueueSize = rstd_ThreadPoolQueueSize,
+              thread_affinity Affinity = thread_affinity::Any);
+    // NOTE: Adds threads or stops the ones above ThreadCount. Stopped threads finish their current job first
+    //       and SetThreadCount() waits for them.
+    void SetThreadCount(thread_pool& Pool, u32 ThreadCount);
+    // NOTE: Runs the jobs which are left on the calling thread, waits for all threads to exit and frees the queues.
+    //       Pool memory can be reused after it returns.
+    void Close(thread_pool& Pool);
+    void PushJob(thread_pool&, void* JobUserData, thread_pool_job_callback* JobCallback,
+                 job_priority Priority = job_priority::Normal);
+    // NOTE: Sum of the telemetry of all workers and helping threads, zeros if rstd_ThreadPoolTelemetryEnabled is 0
+    thread_pool_telemetry GetTelemetry(thread_pool& Pool);
+    // NOTE: Writes the counters of every worker and the summed histograms in microseconds.
+    //       Returns false if rstd_ThreadPoolTelemetryEnabled is 0.
+    rstd_bool WriteTelemetry(thread_pool& Pool, file_stream& Stream);
     template<class job_container> void PushJobs(thread_pool& Pool, job_container Jobs);
+    void CompleteAllJobs(thread_pool& Pool);
+    
+    // NOTE: Splits [Begin, End) into chunks of GrainSize indices and calls Body(ChunkBegin, ChunkEnd) for each of them.
+    //       Pool threads and the calling thread take chunks until there are none left, then ParallelFor() returns.
+    template<class body> void ParallelFor(thread_pool& Pool, u64 Begin, u64 End, u64 GrainSize, body Body);
+    
+    // NOTE: Every thread which takes part accumulates its chunks into its own copy of Identity
+    //       with Body(ChunkBegin, ChunkEnd, Accumulator&) and the copies are merged with Combine(A, B) which returns
+    //       the merged value. Which chunks go to which copy depends on timing, so Combine has to be associative
+    //       and commutative. Copies are kept in scratch memory, so type has to be trivially copyable.
+    template<class type, class body, class combine>
+        type ParallelReduce(thread_pool& Pool, u64 Begin, u64 End, u64 GrainSize, type Identity, body Body, combine Combine);
+    
+    u32 GetLogicalProcessorCount();
+    
+    // NOTE: graph_task is a pool job which runs after all tasks it depends on have finished.
+    //       Task memory is owned by the caller and has to stay valid until Wait() on it returns.
+    //       UnfinishedDependencyCount has one more until Submit(), so the task can't start while it's being set up.
+    //       Closed is set when the task has taken its continuations, after that nothing can depend on it anymore.
+    struct graph_task
+    {
+        thread_pool* Pool;
+        thread_pool_job_callback* Callback;
+        void* UserData;
+        volatile u32 UnfinishedDependencyCount;
+        volatile u32 Finished;
+        rstd_bool Closed;
+        mutex ContinuationMutex;
+        u32 ContinuationCount;
+        graph_task* Continuations[rstd_TaskMaxContinuations];
+    };
+    
+    void Init(graph_task& Task, thread_pool& Pool, void* UserData, thread_pool_job_callback* Callback);
+    // NOTE: Task starts after Dependency has finished. It has to be called before Submit(Task).
+    void AddDependency(graph_task& Task, graph_task& Dependency);
+    void Submit(graph_task& Task);
+    // NOTE: The waiting thread runs pool jobs until Task has finished and its job has left the pool
+    void Wait(graph_task& Task);
+    struct io_queue;
+    // NOTE: Runs pool jobs on the calling thread until Flag isn't 0. With Queue it runs its completions too,
+    //       and while requests are in flight it runs only them, so a long job doesn't hold up a task waiting for one.
+    void RunJobsUntilSet(thread_pool& Pool, volatile u32& Flag, io_queue* Queue = nullptr);
     
     
     ///////////
@@ -5818,6 +7104,7 @@ rstd_defer(rstd::Unlock(_Mutex)); \
     struct file
     {
         void* PlatformFileHandle;
+        rstd_bool Async; // NOTE: Opened for io_queue, blocking Read/Write still work on it
         
         operator rstd_bool()
         { return PlatformFileHandle; }
@@ -5827,6 +7114,67 @@ rstd_defer(rstd::Unlock(_Mutex)); \
     {
         file File;
         u64 Pos;
+        rstd_bool Sequential; // NOTE: Writes go to the file pointer (stdout, pipes) and Pos only counts written bytes
+        
+        // NOTE: Optional write buffer, Pos includes the bytes which weren't flushed yet.
+        //       Call Flush() before you move Pos by hand.
+        u8* WriteBuffer;
+        u32 WriteBufferCount;
+        u32 WriteBufferSize;
+        
+        operator rstd_bool()
+        { return File; }
+    };
+    
+    // NOTE: Reads [Pos, EndPos) of a file in chunks. While you process one chunk the next one is read
+    //       on a background thread into the second buffer. Lines are returned in place (null terminated,
+    //       without \r\n), a line which crosses chunks is moved in front of the next chunk so it stays contiguous.
+    //       A line is valid only until the next ReadLine().
+    struct line_reader
+    {
+        file File;
+        u64 ReadPos;
+        u64 EndPos;
+        char* Buffers[2];
+        u32 ChunkSize;
+        u32 MaxLineLength;
+        u32 CurrentBuffer;
+        char* At;
+        char* BufferEnd;
+        rstd_bool ChunkInFlight;
+        rstd_bool OwnsFile;
+        
+        // NOTE: Request for the prefetch thread
+        u64 RequestPos;
+        u32 RequestSize;
+        u32 RequestBuffer;
+        u32 RequestReadBytes;
+        volatile rstd_bool Quit;
+        void* PrefetchThreadHandle;
+        void* RequestEventHandle;
+        void* ReadyEventHandle;
+        
+        operator rstd_bool()
+        { return File; }
+    };
+    
+    // NOTE: Reads lines of [Pos, EndPos) from the last one to the first one. The file is read backward
+    //       in small windows, so getting the last few lines costs one small read no matter how big the file is.
+    //       The part of a line which crosses windows is moved behind the next window so it stays contiguous.
+    //       Same as with line_reader, lines are null terminated in place and valid only until the next call.
+    struct backward_line_reader
+    {
+        file File;
+        u64 StartPos;
+        u64 ReadPos; // NOTE: [StartPos, ReadPos) wasn't read yet
+        u64 EndPos;
+        char* Buffer; // NOTE: [window | carried part of the line | null terminator]
+        u32 WindowSize;
+        u32 MaxLineLength;
+        char* DataStart;
+        char* At; // NOTE: Lines in [DataStart, At) weren't returned yet
+        rstd_bool Finished;
+        rstd_bool OwnsFile;
         
         operator rstd_bool()
         { return File; }
@@ -5839,6 +7187,53 @@ rstd_defer(rstd::Unlock(_Mutex)); \
         ReadWrite,
     };
     
+    //////////////
+    // ASYNC IO //
+    //////////////
+    enum class io_operation : u32
+    { Read, Write };
+    
+    struct io_request;
+    typedef void io_completion_callback(io_request& Request);
+    
+    // NOTE: The request has to stay alive (and not move) until WaitForCompletion() returns it
+    struct io_request
+    {
+        file File;
+        u64 Pos;
+        void* Buffer;
+        u32 Size;
+        io_operation Operation;
+        void* UserData;
+        // NOTE: Optional, called by RunCompletion(), WaitForCompletion() only returns the request
+        io_completion_callback* Callback;
+        
+        // NOTE: Filled when the request completes
+        u32 TransferredBytes;
+        rstd_bool Succeeded;
+        
+        io_queue* Queue;
+        u64 PlatformOverlapped[4];
+    };
+    
+    // NOTE: Submit/complete queue on top of an IO completion port. Files opened with OpenFile(Path, Mode, Queue)
+    //       are read and written by the kernel asynchronously. Requests on ordinary files are run as blocking
+    //       calls on the fallback thread pool and their completions are posted to the same port.
+    //       Tasks await requests with ReadAsync() and SyncWait(Pool, Task, &Queue) runs their completions.
+    struct io_queue
+    {
+        void* CompletionPortHandle;
+        thread_pool* FallbackPool;
+        volatile u32 InFlightCount;
+    };
+    
+    void Init(io_queue& Queue, thread_pool* FallbackPool = nullptr);
+    void Close(io_queue& Queue);
+    rstd_bool Submit(io_queue& Queue, io_request& Request);
+    io_request* WaitForCompletion(io_queue& Queue, u32 TimeoutInMilliseconds = InvalidU32);
+    // NOTE: Waits for one completion and calls its callback, returns false on timeout
+    rstd_bool RunCompletion(io_queue& Queue, u32 TimeoutInMilliseconds = InvalidU32);
+    
     enum class file_error
     {
         NoError,
@@ -5853,20 +7248,50 @@ rstd_defer(rstd::Unlock(_Mutex)); \
     i32 RenameFile(const char* FilePath, const char* NewFilePath);
     rstd_bool FileExists(const char* FilePath);
     file OpenFile(const char* FilePath, io_mode);
+    file OpenFile(const char* FilePath, io_mode, io_queue& Queue);
     rstd_bool Close(file&);
-    u32 Write(file File, u64 Pos, void* Data, u32 Size);
-    u32 Read(void* Dest, file File, u64 Pos, u32 Size);
-    rstd_bool SetFileSize(file File, u32 Size);
-    u32 GetFileSize(file File);
+    // NOTE: Sizes bigger than MaxBytesPerIoCall are split into several calls
+    constexpr u32 MaxBytesPerIoCall = 1u << 30;
+    u64 Write(file File, u64 Pos, void* Data, u64 Size);
+    u64 Write(file File, void* Data, u64 Size);
+    u64 Read(void* Dest, file File, u64 Pos, u64 Size);
+    rstd_bool SetFileSize(file File, u64 Size);
+    u64 GetFileSize(file File);
     char* ReadWholeFile(arena& Arena, const char* FilePath);
+    file GetStandardOutput();
+    constexpr u32 DefaultLineReaderChunkSize = 1024 * 1024;
+    constexpr u32 DefaultMaxLineLength = 4096;
+    void Init(line_reader& Reader, arena& Arena, file File, u64 Pos, u64 EndPos,
+              u32 ChunkSize = DefaultLineReaderChunkSize, u32 MaxLineLength = DefaultMaxLineLength);
+    rstd_bool OpenLineReader(line_reader& Reader, arena& Arena, const char* FilePath,
+                             u32 ChunkSize = DefaultLineReaderChunkSize, u32 MaxLineLength = DefaultMaxLineLength);
+    rstd_bool ReadLine(line_reader& Reader, string_view& Line);
+    void Close(line_reader& Reader);
+    constexpr u32 DefaultBackwardLineReaderWindowSize = 4096;
+    void Init(backward_line_reader& Reader, arena& Arena, file File, u64 Pos, u64 EndPos,
+              u32 WindowSize = DefaultBackwardLineReaderWindowSize, u32 MaxLineLength = DefaultMaxLineLength);
+    // NOTE: Buffer has to have WindowSize + MaxLineLength + 1 bytes, it can be on the stack
+    void Init(backward_line_reader& Reader, char* Buffer, file File, u64 Pos, u64 EndPos,
+              u32 WindowSize, u32 MaxLineLength);
+    rstd_bool OpenBackwardLineReader(backward_line_reader& Reader, arena& Arena, const char* FilePath,
+                                     u32 WindowSize = DefaultBackwardLineReaderWindowSize,
+                                     u32 MaxLineLength = DefaultMaxLineLength);
+    rstd_bool ReadPreviousLine(backward_line_reader& Reader, string_view& Line);
+    void Close(backward_line_reader& Reader);
     rstd_bool CreateDirectory(const char* Path);
     rstd_bool CreateDirectory(wchar_t* Path);
     rstd_bool DeleteDirectory(const char* Path);
     rstd_bool DeleteDirectory(wchar_t* Path);
     rstd_bool DeleteDirectoryWithAllContents(const char* Path);
     
-    static void SetPosToEndOfFile(file_stream& Stream)
-    { Stream.Pos = GetFileSize(Stream.File); }
+    static rstd_bool Flush(file_stream& Stream);
+    
+    static void SetPosToEndOfFile
+    (file_stream& Stream)
+    {
+        Flush(Stream);
+        Stream.Pos = GetFileSize(Stream.File);
+    }
     
     static backward_singly_linked_list_with_counter<file_info> GetFileInfos(arena& Arena, const rstd_stringlike& DirectoryPath)
     { return GetFileInfos(Arena, DirectoryPath.GetCString()); }
@@ -5956,74 +7381,145 @@ rstd_defer(rstd::Unlock(_Mutex)); \
     static file_stream OpenFileStream(rstd_stringlike& FilePath, io_mode Mode)
     { return OpenFileStream(FilePath.GetCString(), Mode); }
     
-    static rstd_bool Close(file_stream& Stream)
-    { return Close(Stream.File); }
+    static file_stream OpenStandardOutputStream()
+    { return {GetStandardOutput(), 0, true}; }
+    
+    constexpr u32 DefaultWriteBufferSize = 64 * 1024;
+    
+    static void AddWriteBuffer
+    (file_stream& Stream, arena& Arena, u32 Size = DefaultWriteBufferSize)
+    {
+        rstd_AssertM(!Stream.WriteBuffer, "This stream already has a write buffer");
+        Stream.WriteBuffer = (u8*)rstd_PushSizeUninitialized(Arena, Size);
+        Stream.WriteBufferCount = 0;
+        Stream.WriteBufferSize = Size;
+    }
+    
+    static file_stream OpenFileStream
+    (const char* FilePath, io_mode Mode, arena& Arena, u32 WriteBufferSize = DefaultWriteBufferSize)
+    {
+        auto Stream = OpenFileStream(FilePath, Mode);
+        if(Stream)
+            AddWriteBuffer(Stream, Arena, WriteBufferSize);
+        return Stream;
+    }
+    
+    static file_stream OpenStandardOutputStream
+    (arena& Arena, u32 WriteBufferSize = DefaultWriteBufferSize)
+    {
+        auto Stream = OpenStandardOutputStream();
+        if(Stream)
+            AddWriteBuffer(Stream, Arena, WriteBufferSize);
+        return Stream;
+    }
+    
+    static u64 InternalWriteUnbuffered
+    (file_stream& Stream, u64 Pos, void* Data, u64 Size)
+    {
+        u64 WrittenBytes = Stream.Sequential ? Write(Stream.File, Data, Size) : Write(Stream.File, Pos, Data, Size);
+        rstd_Assert(WrittenBytes == Size);
+        return WrittenBytes;
+    }
+    
+    static rstd_bool Flush
+    (file_stream& Stream)
+    {
+        if(Stream.WriteBufferCount == 0)
+            return true;
+        
+        u32 Count = Stream.WriteBufferCount;
+        Stream.WriteBufferCount = 0;
+        u64 WrittenBytes = InternalWriteUnbuffered(Stream, Stream.Pos - Count, Stream.WriteBuffer, Count);
+        
+        // NOTE: Pos counted the whole buffer, bytes which didn't get to the file are taken back from it
+        Stream.Pos -= Count - WrittenBytes;
+        return WrittenBytes == Count;
+    }
+    
+    static rstd_bool Close
+    (file_stream& Stream)
+    {
+        rstd_bool Flushed = Flush(Stream);
+        return Close(Stream.File) && Flushed;
+    }
     
-    template<class type> static u32 WriteStruct(file File, u64 Pos, type& Data, u32 Count = 1)
-    { return Write(File, Pos, (void*)&Data, (u32)sizeof(type) * Count); }
+    template<class type> static u64 WriteStruct(file File, u64 Pos, type& Data, u64 Count = 1)
+    { return Write(File, Pos, (void*)&Data, sizeof(type) * Count); }
     
-    template<class... args> static u32 WriteString
+    template<class... args> static u64 WriteString
     (file File, u64 Pos, const char* Fmt, args... Args)
     {
         // TODO: Probably we should let the user change the size of the string (sometimes 1024 characters might not be enough)
         auto String = Format<string<1024>>(Fmt, Args...);
-        return Write(File, Pos, (void*)String.GetCString(), (u32)String.GetCount());
+        return Write(File, Pos, (void*)String.GetCString(), (u64)String.GetCount());
     }
     
-    static u32 WriteString(file File, u64 Pos, const rstd_stringlike& String)
-    { return Write(File, Pos, (void*)String.GetCString(), (u32)(String.GetCount() * sizeof(*String.GetCString()))); }
+    static u64 WriteString(file File, u64 Pos, const rstd_stringlike& String)
+    { return Write(File, Pos, (void*)String.GetCString(), (u64)(String.GetCount() * sizeof(*String.GetCString()))); }
     
-    static u32 WriteString(file File, u64 Pos, const char* String)
-    { return Write(File, Pos, (void*)String, (u32)strlen(String)); }
+    static u64 WriteString(file File, u64 Pos, const char* String)
+    { return Write(File, Pos, (void*)String, (u64)strlen(String)); }
     
     template<class type> static type Read
     (file File, u64 Pos)
     {
         type Res;
-        Read((void*)&Res, File, Pos, (u32)sizeof(Res));
+        Read((void*)&Res, File, Pos, sizeof(Res));
         return Res;
     }
     
-    static u32 Write
-    (file_stream& Stream, void* Data, u32 Size)
+    // NOTE: Small writes are gathered in the write buffer. Payloads which don't fit in it go straight to the file
+    //       after the buffer is flushed (Win32 has no vectored write for regular buffered handles).
+    //       Returns 0 if flushing the buffer failed and less than Size on a short write, Pos moves by the returned count.
+    static u64 Write
+    (file_stream& Stream, void* Data, u64 Size)
     {
-        u32 WrittenBytes = Write(Stream.File, Stream.Pos, Data, Size);
-        rstd_Assert(WrittenBytes == Size);
-        Stream.Pos += Size;
+        u64 WrittenBytes;
+        if(Stream.WriteBuffer)
+        {
+            if(Stream.WriteBufferCount + Size > Stream.WriteBufferSize && !Flush(Stream))
+                return 0;
+            
+            if(Size < Stream.WriteBufferSize)
+            {
+                memcpy(Stream.WriteBuffer + Stream.WriteBufferCount, Data, (size_t)Size);
+                Stream.WriteBufferCount += (u32)Size;
+                WrittenBytes = Size;
+            }
+            else
+            {
+                WrittenBytes = InternalWriteUnbuffered(Stream, Stream.Pos, Data, Size);
+            }
+        }
+        else
+        {
+            WrittenBytes = InternalWriteUnbuffered(Stream, Stream.Pos, Data, Size);
+        }
+        Stream.Pos += WrittenBytes;
         return WrittenBytes;
     }
     
-    template<class type> static u32 WriteStruct(file_stream& Stream, type& Data, u32 Count = 1)
-    { return Write(Stream, &Data, (u32)sizeof(type) * Count); }
+    template<class type> static u64 WriteStruct(file_stream& Stream, type& Data, u64 Count = 1)
+    { return Write(Stream, &Data, sizeof(type) * Count); }
     
-    template<class... args> static u32 WriteString
+    template<class... args> static u64 WriteString
     (file_stream& Stream, const char* Fmt, args... Args)
     {
-        u32 WrittenBytes = WriteString(Stream.File, Stream.Pos, Fmt, Args...);
-        Stream.Pos += WrittenBytes;
-        return WrittenBytes;
+        auto String = Format<string<1024>>(Fmt, Args...);
+        return Write(Stream, (void*)String.GetCString(), (u64)String.GetCount());
     }
     
-    static u32 WriteString
-    (file_stream& Stream, const rstd_stringlike& String)
-    { 
-        u32 WrittenBytes = WriteString(Stream.File, Stream.Pos, String); 
-        Stream.Pos += WrittenBytes;
-        return WrittenBytes;
-    }
+    static u64 WriteString(file_stream& Stream, const rstd_stringlike& String)
+    { return Write(Stream, (void*)String.GetCString(), (u64)(String.GetCount() * sizeof(*String.GetCString()))); }
     
-    static u32 WriteString
-    (file_stream& Stream, const char* String)
-    { 
-        u32 WrittenBytes = WriteString(Stream.File, Stream.Pos, String); 
-        Stream.Pos += WrittenBytes;
-        return WrittenBytes;
-    }
+    static u64 WriteString(file_stream& Stream, const char* String)
+    { return Write(Stream, (void*)String, (u64)strlen(String)); }
     
-    static u32 Read
-    (void* Dest, file_stream& Stream, u32 Size)
+    static u64 Read
+    (void* Dest, file_stream& Stream, u64 Size)
     {
-        u32 ReadBytes = Read(Dest, Stream.File, Stream.Pos, Size);
+        Flush(Stream);
+        u64 ReadBytes = Read(Dest, Stream.File, Stream.Pos, Size);
         rstd_Assert(ReadBytes == Size); // TODO: Should this assertion be here? Maybe there should be second function which just returns failure?
         Stream.Pos += Size;
         return ReadBytes;
@@ -6032,6 +7528,7 @@ rstd_defer(rstd::Unlock(_Mutex)); \
     template<class type> static type Read
     (file_stream& Stream)
     {
+        Flush(Stream);
         auto Res = Read<type>(Stream.File, Stream.Pos);
         Stream.Pos += sizeof(Res);
         return Res;
@@ -6044,6 +7541,227 @@ rstd_defer(rstd::Unlock(_Mutex)); \
         *DataPtr += sizeof(type);
         return Res;
     }
+    
+    ////////////////
+    // COROUTINES //
+    ////////////////
+#if rstd_CoroutinesEnabled
+    // NOTE: task<type> is a coroutine which starts when it's awaited or passed to SyncWait().
+    //       Its first parameter has to be the arena on which the coroutine frame is pushed. Frames aren't freed,
+    //       they go away with the arena, so use concurrent_arena if tasks are created on many threads.
+    //       Inside a task you can co_await other tasks, ScheduleOn(Pool) to continue on a pool thread
+    //       and ReadAsync() to read a file through an io_queue. Exceptions aren't supported.
+    template<class type> struct task;
+    
+    struct task_promise_base
+    {
+        std::coroutine_handle<> Continuation;
+        volatile u32* Done = nullptr; // NOTE: Set by SyncWait() for the outermost task
+        
+        struct final_awaiter
+        {
+            bool await_ready() noexcept { return false; }
+            void await_resume() noexcept {}
+            
+            template<class promise> std::coroutine_handle<> await_suspend
+            (std::coroutine_handle<promise> Handle) noexcept
+            {
+                auto& Promise = Handle.promise();
+                if(Promise.Continuation)
+                    return Promise.Continuation;
+                
+                // NOTE: SyncWait() can destroy the frame right after this
+                volatile u32* Done = Promise.Done;
+                AtomicStore<memory_order::Release>(*Done, true);
+                return std::noop_coroutine();
+            }
+        };
+        
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        final_awaiter final_suspend() noexcept { return {}; }
+        void unhandled_exception() { rstd_InvalidCodePathM("Exceptions aren't supported in tasks"); }
+        
+        template<class... args> static void* operator new(size Size, arena& Arena, args&...)
+        { return rstd_PushSizeUninitialized(Arena, Size); }
+        
+        template<class... args> static void* operator new(size Size, concurrent_arena& Arena, args&...)
+        { return rstd_PushSizeUninitialized(Arena, Size); }
+        
+        static void operator delete(void*) noexcept {}
+    };
+    
+    template<class type> struct task_promise : task_promise_base
+    {
+        type Value;
+        
+        task<type> get_return_object();
+        void return_value(type NewValue) { Value = NewValue; }
+        type GetResult() { return Value; }
+    };
+    
+    template<> struct task_promise<void> : task_promise_base
+    {
+        task<void> get_return_object();
+        void return_void() {}
+        void GetResult() {}
+    };
+    
+    template<class type> struct task
+    {
+        using promise_type = task_promise<type>;
+        std::coroutine_handle<promise_type> Handle;
+        
+        task(std::coroutine_handle<promise_type> _Handle)
+            :Handle(_Handle) {}
+        
+        task(task&& Other)
+            :Handle(Other.Handle) { Other.Handle = nullptr; }
+        
+        task(const task&) = delete;
+        task& operator=(const task&) = delete;
+        
+        ~task()
+        {
+            if(Handle)
+                Handle.destroy();
+        }
+        
+        bool await_ready() { return false; }
+        type await_resume() { return Handle.promise().GetResult(); }
+        
+        std::coroutine_handle<> await_suspend
+        (std::coroutine_handle<> Awaiting)
+        {
+            Handle.promise().Continuation = Awaiting;
+            return Handle;
+        }
+    };
+    
+    template<class type> task<type> task_promise<type>::get_return_object()
+    { return {std::coroutine_handle<task_promise<type>>::from_promise(*this)}; }
+    
+    inline task<void> task_promise<void>::get_return_object()
+    { return {std::coroutine_handle<task_promise<void>>::from_promise(*this)}; }
+    
+    static void InternalResumeCoroutine(void* CoroutineAddress)
+    { std::coroutine_handle<>::from_address(CoroutineAddress).resume(); }
+    
+    struct schedule_on_awaiter
+    {
+        thread_pool* Pool;
+        
+        bool await_ready() { return false; }
+        void await_resume() {}
+        
+        void await_suspend(std::coroutine_handle<> Handle)
+        { PushJob(*Pool, Handle.address(), InternalResumeCoroutine); }
+    };
+    
+    static schedule_on_awaiter ScheduleOn(thread_pool& Pool)
+    { return {&Pool}; }
+    
+    // NOTE: co_await returns the number of transferred bytes. The task continues on the thread which runs
+    //       the completion, that's SyncWait() with the queue or RunCompletion(). Files which weren't opened
+    //       on the queue are read with a blocking call on its fallback pool.
+    struct io_awaiter
+    {
+        io_queue* Queue;
+        io_request Request;
+        std::coroutine_handle<> Handle;
+        
+        bool await_ready() { return false; }
+        u32 await_resume() { return Request.TransferredBytes; }
+        
+        static void Complete(io_request& Request)
+        { ((io_awaiter*)Request.UserData)->Handle.resume(); }
+        
+        // NOTE: The request is in the coroutine frame, so it doesn't move until the task continues.
+        //       A request which couldn't be submitted doesn't suspend and returns 0 bytes.
+        bool await_suspend
+        (std::coroutine_handle<> _Handle)
+        {
+            Handle = _Handle;
+            Request.UserData = this;
+            Request.Callback = Complete;
+            return Submit(*Queue, Request);
+        }
+    };
+    
+    static io_awaiter ReadAsync
+    (io_queue& Queue, void* Dest, file File, u64 Pos, u32 Size)
+    {
+        io_awaiter Awaiter = {&Queue};
+        Awaiter.Request.File = File;
+        Awaiter.Request.Pos = Pos;
+        Awaiter.Request.Buffer = Dest;
+        Awaiter.Request.Size = Size;
+        Awaiter.Request.Operation = io_operation::Read;
+        return Awaiter;
+    }
+    
+    // NOTE: Starts Task on the calling thread and runs pool jobs until it has finished.
+    //       Pass the queue of the requests the task awaits, their completions are run by this thread.
+    template<class type> type SyncWait
+    (thread_pool& Pool, task<type>&& Task, io_queue* Queue = nullptr)
+    {
+        volatile u32 Done = false;
+        Task.Handle.promise().Done = &Done;
+        Task.Handle.resume();
+        RunJobsUntilSet(Pool, Done, Queue);
+        return Task.Handle.promise().GetResult();
+    }
+#endif
+    
+    /////////////////////
+    // TIMING PROFILER //
+    /////////////////////
+    // NOTE: rstd_TimeBlock("Name") measures the rest of its scope with rdtsc, rstd_TimeFunction measures the whole function.
+    //       Every thread records into its own ring buffer so a zone is two rdtsc and a store, when the buffer
+    //       is full the oldest events are overwritten. Names have to stay alive until the trace is written.
+    //       With rstd_TimingProfilerEnabled 0 the macros are empty.
+    struct timing_event
+    {
+        const char* Name;
+        u64 BeginTsc;
+        u64 EndTsc;
+    };
+    
+    struct timing_thread_buffer
+    {
+        timing_event* Events;
+        u64 EventCount; // NOTE: All events ever recorded, only the last rstd_TimingProfilerEventsPerThread are kept
+        u32 ThreadId;
+        timing_thread_buffer* Next;
+    };
+    
+#if rstd_TimingProfilerEnabled
+    void RecordTimingEvent(const char* Name, u64 BeginTsc, u64 EndTsc);
+    // NOTE: Registers the thread before its first zone begins, so no zone starts before the trace does
+    u64 BeginTimingZone();
+    
+    struct timing_zone
+    {
+        const char* Name;
+        u64 BeginTsc;
+        
+        timing_zone(const char* _Name)
+            :Name(_Name), BeginTsc(BeginTimingZone()) {}
+        
+        ~timing_zone()
+        { RecordTimingEvent(Name, BeginTsc, __rdtsc()); }
+    };
+    
+#define rstd_TimeBlock(_Name) rstd::timing_zone rstd_LineName(TimingZone)(_Name)
+#define rstd_TimeFunction rstd_TimeBlock(__FUNCTION__)
+#else
+#define rstd_TimeBlock(_Name)
+#define rstd_TimeFunction
+#endif
+    
+    // NOTE: Writes the recorded zones as Chrome trace JSON (chrome://tracing or ui.perfetto.dev).
+    //       Call it when other threads don't record anymore. Returns false if the profiler is disabled
+    //       or if the file couldn't be written.
+    rstd_bool WriteTimingTrace(arena& Arena, const char* FilePath);
 }
 
 #ifdef rstd_Implementation
@@ -6073,290 +7791,759 @@ namespace rstd
     void InternalWarningMessageBox(const char* Message)
     { MessageBoxA(0, Message, "Warning!", MB_ICONWARNING|MB_OK); }
     
-    void ShowErrorMessageBox(const char* Message)
-    { MessageBoxA(0, Message, "Error!", MB_ICONERROR|MB_OK); }
+    void ShowErrorMessageBox(const char* Message)
+    { MessageBoxA(0, Message, "Error!", MB_ICONERROR|MB_OK); }
+    
+    void ShowErrorMessageBoxAndExitProcess
+    (const char* Message)
+    {
+        ShowErrorMessageBox(Message);
+        ExitProcess(0);
+    }
+#endif
+    
+    ///////////////////////
+    // MEMORY ALLOCATION //
+    ///////////////////////
+    void* PageAlloc(size Bytes)
+    { return VirtualAlloc(nullptr, Bytes, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE); }
+    
+    void PageFree(void* Memory)
+    { VirtualFree(Memory, 0, MEM_RELEASE); }
+    
+    /////////////////////
+    // MULTI-THREADING //
+    /////////////////////
+#ifdef rstd_ThreadPoolLogging
+#if rstd_ThreadPoolLogging
+#define ThreadPoolLog(_Str, ...) InternalPrintInDebugger(Format(_Str, __VA_ARGS__).GetCString())
+    
+#else
+#define ThreadPoolLog(_Str, ...)
+#endif
+#else
+#define ThreadPoolLog(_Str, ...)
+#endif
+    
+#if rstd_MultiThreadingEnabled
+    static rstd_bool TryPushJob
+    (thread_pool_job_queue& Queue, thread_pool_job Job)
+    {
+        // NOTE: Acquire on Sequence pairs with the release in TryPopJob(), so the cell isn't written while it's read.
+        //       Positions only hand out cells, they don't publish data, so they are relaxed.
+        u64 Pos = AtomicLoad<memory_order::Relaxed>(Queue.EnqueuePos);
+        for(;;)
+        {
+            auto& Cell = Queue.Cells[Pos & Queue.Mask];
+            i64 Difference = (i64)AtomicLoad<memory_order::Acquire>(Cell.Sequence) - (i64)Pos;
+            if(Difference == 0)
+            {
+                u64 PosBeforeSwap = AtomicCompareExchange<memory_order::Relaxed>(Queue.EnqueuePos, Pos + 1, Pos);
+                if(PosBeforeSwap == Pos)
+                {
+                    Cell.Job = Job;
+                    AtomicStore<memory_order::Release>(Cell.Sequence, Pos + 1);
+                    return true;
+                }
+                Pos = PosBeforeSwap;
+            }
+            else if(Difference < 0)
+            {
+                return false; // NOTE: Queue is full
+            }
+            else
+            {
+                Pos = AtomicLoad<memory_order::Relaxed>(Queue.EnqueuePos);
+            }
+        }
+    }
+    
+    static rstd_bool TryPopJob
+    (thread_pool_job_queue& Queue, thread_pool_job& Job)
+    {
+        u64 Pos = AtomicLoad<memory_order::Relaxed>(Queue.DequeuePos);
+        for(;;)
+        {
+            auto& Cell = Queue.Cells[Pos & Queue.Mask];
+            i64 Difference = (i64)AtomicLoad<memory_order::Acquire>(Cell.Sequence) - (i64)(Pos + 1);
+            if(Difference == 0)
+            {
+                u64 PosBeforeSwap = AtomicCompareExchange<memory_order::Relaxed>(Queue.DequeuePos, Pos + 1, Pos);
+                if(PosBeforeSwap == Pos)
+                {
+                    Job = Cell.Job;
+                    AtomicStore<memory_order::Release>(Cell.Sequence, Pos + Queue.Mask + 1);
+                    return true;
+                }
+                Pos = PosBeforeSwap;
+            }
+            else if(Difference < 0)
+            {
+                return false; // NOTE: Queue is empty
+            }
+            else
+            {
+                Pos = AtomicLoad<memory_order::Relaxed>(Queue.DequeuePos);
+            }
+        }
+    }
+    
+    static rstd_bool TryPopJob
+    (thread_pool& Pool, thread_pool_job& Job)
+    { return TryPopJob(Pool.HighPriorityQueue, Job) || TryPopJob(Pool.Queue, Job); }
     
-    void ShowErrorMessageBoxAndExitProcess
-    (const char* Message)
+    // NOTE: Takes up to MaxCount sleeping threads, the caller wakes them up. The first read is a read-modify-write
+    //       so it can't move before the job was pushed, a plain load could miss a thread which just checked the queue.
+    static u32 InternalClaimSleepingThreads
+    (thread_pool& Pool, u32 MaxCount)
     {
-        ShowErrorMessageBox(Message);
-        ExitProcess(0);
+        u32 SleepingThreadCount = AtomicFetchAdd(Pool.SleepingThreadCount, 0);
+        for(;;)
+        {
+            u32 ClaimedCount = SleepingThreadCount < MaxCount ? SleepingThreadCount : MaxCount;
+            if(!ClaimedCount)
+                return 0;
+            
+            u32 Previous = AtomicCompareExchange(Pool.SleepingThreadCount, SleepingThreadCount - ClaimedCount, SleepingThreadCount);
+            if(Previous == SleepingThreadCount)
+                return ClaimedCount;
+            SleepingThreadCount = Previous;
+        }
     }
-#endif
     
-    ///////////////////////
-    // MEMORY ALLOCATION //
-    ///////////////////////
-    void* PageAlloc(size Bytes)
-    { return VirtualAlloc(nullptr, Bytes, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE); }
+    static void InternalWakeThreads
+    (thread_pool& Pool, u32 JobCount)
+    {
+        u32 ThreadsToWakeCount = InternalClaimSleepingThreads(Pool, JobCount);
+        ThreadPoolLog("ReleaseSemaphore - ThreadsToWakeCount: %\n", ThreadsToWakeCount);
+        if(ThreadsToWakeCount)
+            ReleaseSemaphore(Pool.SemaphoreHandle, ThreadsToWakeCount, nullptr);
+    }
     
-    void PageFree(void* Memory)
-    { VirtualFree(Memory, 0, MEM_RELEASE); }
+#if rstd_ThreadPoolTelemetryEnabled
+    static thread_local thread_pool_worker* CurrentThreadPoolWorker;
     
-    /////////////////////
-    // MULTI-THREADING //
-    /////////////////////
-#ifdef rstd_ThreadPoolLogging
-#if rstd_ThreadPoolLogging
-    namespace ThreadPoolLogging
+    static void InternalAddToHistogram
+    (volatile u64* Histogram, u64 Ticks, rstd_bool Shared)
     {
-        map<u32, char, 64> ThreadLetterMap;
-        char NextLetter = 'A';
+        unsigned long Bucket = 0;
+        _BitScanReverse64(&Bucket, Ticks | 1);
+        if(Bucket >= ThreadPoolHistogramBucketCount)
+            Bucket = ThreadPoolHistogramBucketCount - 1;
+        if(Shared)
+            AtomicIncrement(Histogram[Bucket]);
+        else
+            ++Histogram[Bucket];
     }
     
-#define ThreadPoolLog(_Str, ...) InternalPrintInDebugger(Format(_Str, __VA_ARGS__).GetCString())
-    
-#else
-#define ThreadPoolLog(_Str, ...)
+    static void InternalRecordJob
+    (thread_pool& Pool, u64 QueueWaitTicks, u64 RunTicks)
+    {
+        auto* Worker = CurrentThreadPoolWorker;
+        rstd_bool Shared = !Worker || Worker->Pool != &Pool;
+        auto& Telemetry = Shared ? Pool.HelperTelemetry : Worker->Telemetry;
+        if(Shared)
+        {
+            AtomicIncrement(Telemetry.JobCount);
+            AtomicAdd(Telemetry.QueueWaitTicks, QueueWaitTicks);
+            AtomicAdd(Telemetry.RunTicks, RunTicks);
+        }
+        else
+        {
+            ++Telemetry.JobCount;
+            Telemetry.QueueWaitTicks += QueueWaitTicks;
+            Telemetry.RunTicks += RunTicks;
+        }
+        InternalAddToHistogram(Telemetry.QueueWaitHistogram, QueueWaitTicks, Shared);
+        InternalAddToHistogram(Telemetry.RunHistogram, RunTicks, Shared);
+    }
 #endif
+    
+    static void RunJob
+    (thread_pool& Pool, thread_pool_job Job)
+    {
+#if rstd_ThreadPoolTelemetryEnabled
+        u64 BeginTsc = __rdtsc();
+        Job.Callback(Job.CallbackUserData);
+        InternalRecordJob(Pool, BeginTsc - Job.PushTsc, __rdtsc() - BeginTsc);
 #else
-#define ThreadPoolLog(_Str, ...)
+        Job.Callback(Job.CallbackUserData);
 #endif
+        AtomicDecrement(Pool.PendingJobCount);
+        if(Job.FinishedFlag)
+            AtomicStore<memory_order::Release>(*Job.FinishedFlag, 1);
+    }
     
-    u32 AtomicIncrement
-    (volatile u32& A)
+    // NOTE: Back-pressure, a producer which finds the queue full helps with the jobs instead of waiting
+    static void InternalPushJob
+    (thread_pool& Pool, thread_pool_job Job, job_priority Priority = job_priority::Normal)
     {
-#if rstd_MultiThreadingEnabled
-        return InterlockedIncrement(&A);
-#else
-        return ++A;
+        auto& Queue = Priority == job_priority::High ? Pool.HighPriorityQueue : Pool.Queue;
+#if rstd_ThreadPoolTelemetryEnabled
+        Job.PushTsc = __rdtsc();
 #endif
+        AtomicIncrement(Pool.PendingJobCount);
+        while(!TryPushJob(Queue, Job))
+        {
+            thread_pool_job JobToRun;
+            if(TryPopJob(Pool, JobToRun))
+                RunJob(Pool, JobToRun);
+            else
+                _mm_pause();
+        }
     }
     
-    u32 AtomicDecrement
-    (volatile u32& A)
+    DWORD WINAPI ThreadProc
+    (LPVOID WorkerVoidPtr)
     {
-#if rstd_MultiThreadingEnabled
-        return InterlockedDecrement(&A);
+        auto& Worker = *(thread_pool_worker*)WorkerVoidPtr;
+        thread_pool& ThreadPool = *Worker.Pool;
+#if rstd_ThreadPoolLogging
+        char ThreadLetter = (char)('A' + Worker.Index % 26);
+#endif
+        ThreadPoolLog("Thread % starts\n", ThreadLetter);
+#if rstd_ThreadPoolTelemetryEnabled
+        CurrentThreadPoolWorker = &Worker;
+#endif
+        
+        while(Worker.Index < AtomicLoad<memory_order::Acquire>(ThreadPool.ThreadCount))
+        {
+            thread_pool_job Job;
+            while(Worker.Index < AtomicLoad<memory_order::Acquire>(ThreadPool.ThreadCount) && TryPopJob(ThreadPool, Job))
+            {
+                ThreadPoolLog("Thread % About to call Callback\n", ThreadLetter);
+                RunJob(ThreadPool, Job);
+            }
+            
+            // NOTE: A job pushed right before the thread counted itself as sleeping didn't wake anyone,
+            //       so the queue is checked once more. If a pusher has already taken this thread, its wake up
+            //       makes a later wait return right away.
+            AtomicIncrement(ThreadPool.SleepingThreadCount);
+            rstd_bool Stopped = Worker.Index >= AtomicLoad<memory_order::Acquire>(ThreadPool.ThreadCount);
+            rstd_bool HasJob = !Stopped && TryPopJob(ThreadPool, Job);
+            if(Stopped || HasJob)
+            {
+                InternalClaimSleepingThreads(ThreadPool, 1);
+                if(HasJob)
+                    RunJob(ThreadPool, Job);
+                continue;
+            }
+            
+            ThreadPoolLog("Thread % going to sleep\n", ThreadLetter);
+#if rstd_ThreadPoolTelemetryEnabled
+            u64 SleepTsc = __rdtsc();
+            WaitForSingleObjectEx(ThreadPool.SemaphoreHandle, INFINITE, FALSE);
+            Worker.Telemetry.IdleTicks += __rdtsc() - SleepTsc;
 #else
-        return --A;
+            WaitForSingleObjectEx(ThreadPool.SemaphoreHandle, INFINITE, FALSE);
 #endif
+            ThreadPoolLog("Thread % awakes\n", ThreadLetter);
+        }
+        ThreadPoolLog("Thread % exits\n", ThreadLetter);
+        ReleaseScratchArenas();
+        return 0;
     }
     
-    u64 AtomicIncrement
-    (volatile u64& A)
+    static void InternalSetAffinity
+    (thread_pool_worker& Worker, thread_affinity Affinity)
     {
-#if rstd_MultiThreadingEnabled
-        return InterlockedIncrement64((LONG64*)&A);
-#else
-        return ++A;
+        GROUP_AFFINITY GroupAffinity = {};
+        if(Affinity == thread_affinity::Core)
+        {
+            u32 ProcessorIndex = Worker.Index % GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+            WORD GroupCount = GetActiveProcessorGroupCount();
+            for(WORD Group = 0; Group < GroupCount; ++Group)
+            {
+                u32 GroupProcessorCount = GetActiveProcessorCount(Group);
+                if(ProcessorIndex < GroupProcessorCount)
+                {
+                    GroupAffinity.Group = Group;
+                    GroupAffinity.Mask = (KAFFINITY)1 << ProcessorIndex;
+                    break;
+                }
+                ProcessorIndex -= GroupProcessorCount;
+            }
+        }
+        else if(Affinity == thread_affinity::NumaNode)
+        {
+            ULONG HighestNode = 0;
+            GetNumaHighestNodeNumber(&HighestNode);
+            if(!GetNumaNodeProcessorMaskEx((USHORT)(Worker.Index % (HighestNode + 1)), &GroupAffinity))
+                return;
+        }
+        
+        if(GroupAffinity.Mask)
+            SetThreadGroupAffinity(Worker.ThreadHandle, &GroupAffinity, nullptr);
+    }
+    
+    static void InternalStartWorker
+    (thread_pool& Pool, u32 WorkerIndex)
+    {
+        auto& Worker = Pool.Workers[WorkerIndex];
+        Worker.Pool = &Pool;
+        Worker.Index = WorkerIndex;
+        
+        // NOTE: Thread starts suspended so it doesn't run a job before it is pinned
+        Worker.ThreadHandle = CreateThread(0, 0, ThreadProc, &Worker, CREATE_SUSPENDED, nullptr);
+        rstd_RAssert(Worker.ThreadHandle, "Failed to create a thread pool thread");
+        
+        if(Pool.Affinity != thread_affinity::Any)
+            InternalSetAffinity(Worker, Pool.Affinity);
+        ResumeThread(Worker.ThreadHandle);
+    }
+    
+    static void InternalInit
+    (thread_pool_job_queue& Queue, u32 QueueSize)
+    {
+        rstd_AssertM((QueueSize & (QueueSize - 1)) == 0, "QueueSize has to be a power of 2");
+        Queue.Cells = (thread_pool_job_cell*)PageAlloc(QueueSize * sizeof(thread_pool_job_cell));
+        rstd_RAssert(Queue.Cells, "OS Allocation call failed (probably your machine ran out of memory)");
+        Queue.Mask = QueueSize - 1;
+        rstd_For(CellIndex, QueueSize)
+            Queue.Cells[CellIndex].Sequence = CellIndex;
+    }
 #endif
+    
+    // NOTE: rdtsc frequency is measured against the performance counter from the start values until now,
+    //       it has to be at least a few milliseconds to be precise
+    static f64 InternalGetTscPerMicrosecond
+    (u64 StartTsc, i64 StartPerformanceCounter)
+    {
+        LARGE_INTEGER Counter, Frequency;
+        QueryPerformanceCounter(&Counter);
+        QueryPerformanceFrequency(&Frequency);
+        i64 ElapsedCounter = Counter.QuadPart - StartPerformanceCounter;
+        if(ElapsedCounter < Frequency.QuadPart / 100)
+        {
+            Sleep(10);
+            QueryPerformanceCounter(&Counter);
+            ElapsedCounter = Counter.QuadPart - StartPerformanceCounter;
+        }
+        return (f64)(__rdtsc() - StartTsc) / ((f64)ElapsedCounter * 1000000.0 / (f64)Frequency.QuadPart);
+    }
+    
+    u32 GetLogicalProcessorCount()
+    {
+        SYSTEM_INFO SystemInfo;
+        GetSystemInfo(&SystemInfo);
+        return SystemInfo.dwNumberOfProcessors;
     }
     
-    u64 AtomicDecrement
-    (volatile u64& A)
+    void Init
+    (thread_pool& Pool, u32 ThreadCount, u32 QueueSize, thread_affinity Affinity)
     {
 #if rstd_MultiThreadingEnabled
-        return InterlockedDecrement64((LONG64*)&A);
-#else
-        return --A;
+        Pool = {};
+        InternalInit(Pool.Queue, QueueSize);
+        InternalInit(Pool.HighPriorityQueue, rstd_ThreadPoolHighPriorityQueueSize);
+        Pool.SemaphoreHandle = CreateSemaphore(0, 0, rstd_ThreadPoolMaxThreadCount, nullptr);
+        Pool.Affinity = Affinity;
+#if rstd_ThreadPoolTelemetryEnabled
+        LARGE_INTEGER Counter;
+        QueryPerformanceCounter(&Counter);
+        Pool.TelemetryStartPerformanceCounter = Counter.QuadPart;
+        Pool.TelemetryStartTsc = __rdtsc();
+#endif
+        SetThreadCount(Pool, ThreadCount);
 #endif
     }
     
-    i32 AtomicSet
-    (volatile i32& Destination, i32 NewValue)
+    void SetThreadCount
+    (thread_pool& Pool, u32 ThreadCount)
     {
 #if rstd_MultiThreadingEnabled
-        i32 InitialValueInDestination = InterlockedExchange((LONG*)&Destination, NewValue);
-#else
-        i32 InitialValueInDestination = Destination;
-        Destination = NewValue;
+        rstd_AssertM(ThreadCount <= rstd_ThreadPoolMaxThreadCount, "Increase rstd_ThreadPoolMaxThreadCount");
+        rstd_ScopeLock(Pool.ResizeMutex);
+        u32 OldThreadCount = Pool.ThreadCount;
+        AtomicStore<memory_order::Release>(Pool.ThreadCount, ThreadCount);
+        
+        for(u32 WorkerIndex = OldThreadCount; WorkerIndex < ThreadCount; ++WorkerIndex)
+            InternalStartWorker(Pool, WorkerIndex);
+        
+        if(ThreadCount < OldThreadCount)
+        {
+            // NOTE: Sleeping threads which stay can take the wake ups too, so we wake until the stopped ones exit
+            for(u32 WorkerIndex = ThreadCount; WorkerIndex < OldThreadCount; ++WorkerIndex)
+            {
+                auto& Worker = Pool.Workers[WorkerIndex];
+                while(WaitForSingleObject(Worker.ThreadHandle, 1) == WAIT_TIMEOUT)
+                    InternalWakeThreads(Pool, OldThreadCount);
+                CloseHandle(Worker.ThreadHandle);
+                Worker.ThreadHandle = nullptr;
+            }
+        }
 #endif
-        return InitialValueInDestination;
     }
     
-    i32 AtomicCompareAndSet
-    (volatile i32& Destination, i32 NewValue, i32 ValueThatShouldBeInDestination)
+    void PushJob
+    (thread_pool& Pool, void* JobUserData, thread_pool_job_callback* JobCallback, job_priority Priority)
     {
 #if rstd_MultiThreadingEnabled
-        i32 ValueThatReallyIsInDestination = InterlockedCompareExchange((volatile LONG*)&Destination,
-                                                                        NewValue, ValueThatShouldBeInDestination);
-        return ValueThatReallyIsInDestination;
+        InternalPushJob(Pool, {JobUserData, JobCallback}, Priority);
+        InternalWakeThreads(Pool, 1);
 #else
-        Destination = NewValue;
-        return Destination;
+        JobCallback(JobUserData);
 #endif
     }
     
-    i64 AtomicCompareAndSet
-    (volatile i64& Destination, i64 NewValue, i64 ValueThatShouldBeInDestination)
+    void Close
+    (thread_pool& Pool)
     {
 #if rstd_MultiThreadingEnabled
-        i64 ValueThatReallyIsInDestination = InterlockedCompareExchange64(&Destination, NewValue, ValueThatShouldBeInDestination);
-        return ValueThatReallyIsInDestination;
-#else
-        Destination = NewValue;
-        return Destination;
+        CompleteAllJobs(Pool);
+        SetThreadCount(Pool, 0);
+        PageFree(Pool.Queue.Cells);
+        PageFree(Pool.HighPriorityQueue.Cells);
+        CloseHandle(Pool.SemaphoreHandle);
+        Pool.Queue.Cells = nullptr;
+        Pool.HighPriorityQueue.Cells = nullptr;
+        Pool.SemaphoreHandle = nullptr;
 #endif
     }
     
-#if rstd_MultiThreadingEnabled
-    thread_pool_job* PopJob
-    (thread_pool_job_list& List)
+    static void InternalAddTelemetry
+    (thread_pool_telemetry& Sum, thread_pool_telemetry& Telemetry)
     {
-        rstd_Assert(List.Mutex.Locked);
-        auto* JobToDo = List.NextJobToTake;
-        if(List.NextJobToTake == List.LastJobToTake)
-            List.NextJobToTake = List.LastJobToTake = nullptr;
-        else
-            List.NextJobToTake = List.NextJobToTake->Next;
-        return JobToDo;
+        Sum.JobCount += Telemetry.JobCount;
+        Sum.QueueWaitTicks += Telemetry.QueueWaitTicks;
+        Sum.RunTicks += Telemetry.RunTicks;
+        Sum.IdleTicks += Telemetry.IdleTicks;
+        rstd_For(Bucket, ThreadPoolHistogramBucketCount)
+        {
+            Sum.QueueWaitHistogram[Bucket] += Telemetry.QueueWaitHistogram[Bucket];
+            Sum.RunHistogram[Bucket] += Telemetry.RunHistogram[Bucket];
+        }
     }
-#endif
     
-#if rstd_MultiThreadingEnabled
-    DWORD WINAPI ThreadProc
-    (LPVOID ThreadPoolVoidPtr)
+    thread_pool_telemetry GetTelemetry
+    (thread_pool& Pool)
     {
-#if rstd_ThreadPoolLogging
-        u32 ThreadId = GetThreadID();
-        char ThreadLetter = ThreadPoolLogging::ThreadLetterMap.FindEqualValueWithAssert(ThreadId);
+        thread_pool_telemetry Res = {};
+#if rstd_MultiThreadingEnabled && rstd_ThreadPoolTelemetryEnabled
+        for(auto& Worker : Pool.Workers)
+            InternalAddTelemetry(Res, Worker.Telemetry);
+        InternalAddTelemetry(Res, Pool.HelperTelemetry);
 #endif
-        ThreadPoolLog("Thread % starts\n", ThreadId);
+        return Res;
+    }
+    
+    rstd_bool WriteTelemetry
+    (thread_pool& Pool, file_stream& Stream)
+    {
+#if rstd_MultiThreadingEnabled && rstd_ThreadPoolTelemetryEnabled
+        f64 TscPerMicrosecond = InternalGetTscPerMicrosecond(Pool.TelemetryStartTsc, Pool.TelemetryStartPerformanceCounter);
+        auto Microseconds = [TscPerMicrosecond](u64 Ticks){ return ToString((f64)Ticks / TscPerMicrosecond, 1); };
         
-        thread_pool& ThreadPool = *(thread_pool*)ThreadPoolVoidPtr;
-        auto& List = ThreadPool.JobList;
-        for(;;)
+        WriteString(Stream, "worker, jobs, queue wait us, run us, idle us\n");
+        for(auto& Worker : Pool.Workers)
         {
-            ThreadPoolLog("Thread % at the begining of loop\n", ThreadLetter);
-            while(List.NextJobToTake)
+            if(Worker.Pool)
             {
-                if(TryLock(List.Mutex))
-                {
-                    ThreadPoolLog("Mutex is locked by thread: %\n", ThreadLetter);
-                    
-                    auto* CurrentJob = PopJob(List);
-                    
-                    AtomicIncrement(ThreadPool.RunningJobCount);
-                    Unlock(List.Mutex);
-                    ThreadPoolLog("Mutex is unlocked by thread: %\n", ThreadLetter);
-                    
-                    ThreadPoolLog("Thread % About to call Callback\n", ThreadLetter);
-                    CurrentJob->Callback(CurrentJob->CallbackUserData);
-                    AtomicDecrement(ThreadPool.RunningJobCount);
-                }
+                auto& Telemetry = Worker.Telemetry;
+                WriteString(Stream, "%, %, %, %, %\n", Worker.Index, Telemetry.JobCount, Microseconds(Telemetry.QueueWaitTicks),
+                            Microseconds(Telemetry.RunTicks), Microseconds(Telemetry.IdleTicks));
             }
-            ThreadPoolLog("Thread % going to sleep\n", ThreadLetter);
-            WaitForSingleObjectEx(ThreadPool.SemaphoreHandle, INFINITE, FALSE);
-            ThreadPoolLog("Thread % awakes\n", ThreadLetter);
         }
-    }
+        auto& Helpers = Pool.HelperTelemetry;
+        WriteString(Stream, "helpers, %, %, %, -\n", Helpers.JobCount,
+                    Microseconds(Helpers.QueueWaitTicks), Microseconds(Helpers.RunTicks));
+        
+        // NOTE: Bucket is written as the time which all jobs in it are shorter than
+        auto Sum = GetTelemetry(Pool);
+        WriteString(Stream, "\nshorter than us, queue wait jobs, run jobs\n");
+        rstd_For(Bucket, ThreadPoolHistogramBucketCount)
+        {
+            if(Sum.QueueWaitHistogram[Bucket] || Sum.RunHistogram[Bucket])
+            {
+                // NOTE: Last bucket has no upper bound
+                if(Bucket == ThreadPoolHistogramBucketCount - 1)
+                    WriteString(Stream, "-, %, %\n", Sum.QueueWaitHistogram[Bucket], Sum.RunHistogram[Bucket]);
+                else
+                    WriteString(Stream, "%, %, %\n", Microseconds(2ull << Bucket),
+                                Sum.QueueWaitHistogram[Bucket], Sum.RunHistogram[Bucket]);
+            }
+        }
+        return true;
+#else
+        return false;
 #endif
+    }
     
-    void Init
-    (thread_pool& Pool, u32 ThreadCount, arena Arena)
+    template<class job_container>
+        void PushJobs
+    (thread_pool& Pool, job_container Jobs)
     {
 #if rstd_MultiThreadingEnabled
-        Pool = {};
-        
-        Pool.JobList.Arena = Arena;
-        Pool.SemaphoreHandle = CreateSemaphore(0, 0, ThreadCount, nullptr);
-        Pool.ThreadCount = ThreadCount;
-        
-        for(u32 ThreadIndex = 0; ThreadIndex < ThreadCount; ++ThreadIndex)
+        u32 PushedJobCount = 0;
+        for(auto Job : Jobs)
         {
-            DWORD ThreadId;
-            auto ThreadHandle = CreateThread(0, 0, ThreadProc, &Pool, 0, &ThreadId);
-            
-#if rstd_ThreadPoolLogging
-            ThreadPoolLogging::ThreadLetterMap.Push(ThreadId, ThreadPoolLogging::NextLetter++);
-#endif
-            
-            CloseHandle(ThreadHandle); // TODO: Support changing number of threads in runtime?
+            InternalPushJob(Pool, Job);
+            ++PushedJobCount;
         }
+        InternalWakeThreads(Pool, PushedJobCount);
+#else
+        for(auto Job : Jobs)
+            Job.Callback(Job.CallbackUserData);
 #endif
     }
     
-    void PushJob
-    (thread_pool& Pool, void* JobUserData, thread_pool_job_callback* JobCallback)
+    // NOTE: The calling thread runs jobs too until every pushed job has finished
+    void CompleteAllJobs
+    (thread_pool& Pool)
     {
 #if rstd_MultiThreadingEnabled
-        auto& List = Pool.JobList;
-        auto* JobNode = &rstd_PushStructZero(List.Arena, thread_pool_job_node);
-        JobNode->CallbackUserData = JobUserData;
-        JobNode->Callback = JobCallback;
-        
-        Lock(List.Mutex);
-        ThreadPoolLog("Mutex is locked by PushJob\n");
-        if(List.NextJobToTake)
+        while(Pool.PendingJobCount)
         {
-            List.LastJobToTake->Next = JobNode;
-            List.LastJobToTake = JobNode;
+            thread_pool_job Job;
+            if(TryPopJob(Pool, Job))
+                RunJob(Pool, Job);
+            else
+                _mm_pause();
         }
-        else
+#endif
+    }
+    
+    // NOTE: Shared by everyone who works on one ParallelFor() or ParallelReduce() call, it lives on the stack
+    //       of the calling thread. Participant 0 is the calling thread and helper jobs take the next indices.
+    struct parallel_for_state
+    {
+        void* Body;
+        void (*RunChunk)(parallel_for_state& State, u32 ParticipantIndex, u64 ChunkBegin, u64 ChunkEnd);
+        u64 Begin, End, GrainSize, ChunkCount;
+        volatile u64 NextChunk;
+        volatile u32 NextParticipantIndex;
+        volatile u32 FinishedHelperCount;
+    };
+    
+    static void InternalTakeChunks
+    (parallel_for_state& State, u32 ParticipantIndex)
+    {
+        for(;;)
         {
-            List.NextJobToTake = List.LastJobToTake = JobNode;
+            u64 Chunk = AtomicAdd(State.NextChunk, 1);
+            if(Chunk >= State.ChunkCount)
+                break;
+            
+            u64 ChunkBegin = State.Begin + Chunk * State.GrainSize;
+            u64 ChunkEnd = State.End - ChunkBegin > State.GrainSize ? ChunkBegin + State.GrainSize : State.End;
+            State.RunChunk(State, ParticipantIndex, ChunkBegin, ChunkEnd);
         }
-        Unlock(List.Mutex);
-        ThreadPoolLog("Mutex is unlocked by PushJob\n");
-        
-        ReleaseSemaphore(Pool.SemaphoreHandle, 1, 0);
-        ThreadPoolLog("Thread should be awaken now\n");
+    }
+    
+    static void InternalParallelForJob
+    (void* StateVoidPtr)
+    {
+        auto& State = *(parallel_for_state*)StateVoidPtr;
+        InternalTakeChunks(State, AtomicIncrement(State.NextParticipantIndex));
+        // NOTE: State can be gone right after this
+        AtomicIncrement(State.FinishedHelperCount);
+    }
+    
+    static u32 InternalGetParallelForHelperCount
+    (thread_pool& Pool, u64 ChunkCount)
+    {
+#if rstd_MultiThreadingEnabled
+        if(ChunkCount <= 1)
+            return 0;
+        return ChunkCount - 1 < Pool.ThreadCount ? (u32)(ChunkCount - 1) : Pool.ThreadCount;
 #else
-        JobCallback(JobUserData);
+        return 0;
 #endif
     }
     
-    template<class job_container>
-        void PushJobs
-    (thread_pool& Pool, job_container Jobs)
+    static void InternalRunParallelFor
+    (thread_pool& Pool, parallel_for_state& State, u32 HelperCount)
     {
 #if rstd_MultiThreadingEnabled
-        auto& List = Pool.JobList;
-        
-        u32 PushedJobCount = Jobs.GetCount();
+        rstd_For(HelperIndex, HelperCount)
+            InternalPushJob(Pool, {&State, InternalParallelForJob});
+        InternalWakeThreads(Pool, HelperCount);
+#endif
         
-        Lock(List.Mutex);
-        ThreadPoolLog("Mutex is locked by PushJob\n");
+        InternalTakeChunks(State, 0);
         
-        if(!List.NextJobToTake)
+#if rstd_MultiThreadingEnabled
+        // NOTE: Helper jobs can still wait in the queue behind other jobs, so the calling thread runs jobs
+        //       while it waits. This also keeps ParallelFor() from a pool job from waiting on itself.
+        while(State.FinishedHelperCount != HelperCount)
         {
-            auto LastJob = Jobs.GetAndPopLast();
-            auto* JobNode = rstd_PushStruct(&List.Arena, thread_pool_job_node{LastJob});
-            List.NextJobToTake = List.LastJobToTake = JobNode;
+            thread_pool_job Job;
+            if(TryPopJob(Pool, Job))
+                RunJob(Pool, Job);
+            else
+                _mm_pause();
         }
-        
-        for(auto Job : Jobs)
+#endif
+    }
+    
+    static u64 InternalGetChunkCount(u64 Begin, u64 End, u64 GrainSize)
+    { return End > Begin ? (End - Begin + GrainSize - 1) / GrainSize : 0; }
+    
+    template<class body> static void InternalRunParallelForChunk
+    (parallel_for_state& State, u32 ParticipantIndex, u64 ChunkBegin, u64 ChunkEnd)
+    { (*(body*)State.Body)(ChunkBegin, ChunkEnd); }
+    
+    template<class body>
+        void ParallelFor
+    (thread_pool& Pool, u64 Begin, u64 End, u64 GrainSize, body Body)
+    {
+        rstd_AssertM(GrainSize > 0, "GrainSize has to be bigger than 0");
+        parallel_for_state State = {};
+        State.Body = &Body;
+        State.RunChunk = InternalRunParallelForChunk<body>;
+        State.Begin = Begin;
+        State.End = End;
+        State.GrainSize = GrainSize;
+        State.ChunkCount = InternalGetChunkCount(Begin, End, GrainSize);
+        InternalRunParallelFor(Pool, State, InternalGetParallelForHelperCount(Pool, State.ChunkCount));
+    }
+    
+    template<class type, class body> struct parallel_reduce_body
+    {
+        body* Body;
+        u8* Accumulators;
+        size AccumulatorStride; // NOTE: Every accumulator is on its own cache line
+    };
+    
+    template<class type, class body> static void InternalRunParallelReduceChunk
+    (parallel_for_state& State, u32 ParticipantIndex, u64 ChunkBegin, u64 ChunkEnd)
+    {
+        auto& Reduce = *(parallel_reduce_body<type, body>*)State.Body;
+        auto& Accumulator = *(type*)(Reduce.Accumulators + ParticipantIndex * Reduce.AccumulatorStride);
+        (*Reduce.Body)(ChunkBegin, ChunkEnd, Accumulator);
+    }
+    
+    template<class type, class body, class combine>
+        type ParallelReduce
+    (thread_pool& Pool, u64 Begin, u64 End, u64 GrainSize, type Identity, body Body, combine Combine)
+    {
+        rstd_AssertM(GrainSize > 0, "GrainSize has to be bigger than 0");
+        constexpr size CacheLineSize = 64;
+        u64 ChunkCount = InternalGetChunkCount(Begin, End, GrainSize);
+        u32 HelperCount = InternalGetParallelForHelperCount(Pool, ChunkCount);
+        u32 ParticipantCount = HelperCount + 1;
+        
+        auto Scratch = GetScratch();
+        parallel_reduce_body<type, body> Reduce;
+        Reduce.Body = &Body;
+        Reduce.AccumulatorStride = ConstAlign(sizeof(type), CacheLineSize);
+        auto* Memory = (u8*)rstd_PushSizeUninitialized(Scratch, ParticipantCount * Reduce.AccumulatorStride + CacheLineSize);
+        Reduce.Accumulators = (u8*)Align((size)Memory, CacheLineSize);
+        rstd_For(ParticipantIndex, ParticipantCount)
+            *(type*)(Reduce.Accumulators + ParticipantIndex * Reduce.AccumulatorStride) = Identity;
+        
+        parallel_for_state State = {};
+        State.Body = &Reduce;
+        State.RunChunk = InternalRunParallelReduceChunk<type, body>;
+        State.Begin = Begin;
+        State.End = End;
+        State.GrainSize = GrainSize;
+        State.ChunkCount = ChunkCount;
+        InternalRunParallelFor(Pool, State, HelperCount);
+        
+        type Res = *(type*)Reduce.Accumulators;
+        for(u32 ParticipantIndex = 1; ParticipantIndex < ParticipantCount; ++ParticipantIndex)
+            Res = Combine(Res, *(type*)(Reduce.Accumulators + ParticipantIndex * Reduce.AccumulatorStride));
+        return Res;
+    }
+    
+    void Init
+    (graph_task& Task, thread_pool& Pool, void* UserData, thread_pool_job_callback* Callback)
+    {
+        Task.Pool = &Pool;
+        Task.Callback = Callback;
+        Task.UserData = UserData;
+        Task.UnfinishedDependencyCount = 1;
+        Task.Finished = false;
+        Task.Closed = false;
+        Task.ContinuationMutex = {};
+        Task.ContinuationCount = 0;
+    }
+    
+    void AddDependency
+    (graph_task& Task, graph_task& Dependency)
+    {
+        rstd_ScopeLock(Dependency.ContinuationMutex);
+        if(Dependency.Closed)
+            return;
+        rstd_AssertM(Dependency.ContinuationCount < rstd_TaskMaxContinuations, "Increase rstd_TaskMaxContinuations");
+        AtomicIncrement(Task.UnfinishedDependencyCount);
+        Dependency.Continuations[Dependency.ContinuationCount++] = &Task;
+    }
+    
+    static void InternalRunTask(void* TaskVoidPtr);
+    
+    // NOTE: Finished is set by RunJob() and not by the task, so Wait() can't return while a worker
+    //       still touches the task or PendingJobCount of the pool
+    static void InternalReleaseDependency
+    (graph_task& Task)
+    {
+        if(AtomicDecrement(Task.UnfinishedDependencyCount) == 0)
         {
-            auto* JobNode = rstd_PushStruct(&List.Arena, thread_pool_job_node{Job});
-            List.LastJobToTake->Next = JobNode;
-            List.LastJobToTake = JobNode;
+#if rstd_MultiThreadingEnabled
+            InternalPushJob(*Task.Pool, {&Task, InternalRunTask, &Task.Finished});
+            InternalWakeThreads(*Task.Pool, 1);
+#else
+            InternalRunTask(&Task);
+            Task.Finished = true;
+#endif
         }
+    }
+    
+    static void InternalRunTask
+    (void* TaskVoidPtr)
+    {
+        auto& Task = *(graph_task*)TaskVoidPtr;
+        Task.Callback(Task.UserData);
         
-        Unlock(List.Mutex);
-        ThreadPoolLog("Mutex is unlocked by PushJob\n");
-        
-        u32 ThreadsToAwakeCount = PushedJobCount > Pool.ThreadCount ? Pool.ThreadCount : PushedJobCount;
-        LONG WorkingThreadCount = 0;
-        ThreadPoolLog("ReleaseSemaphore 1 - ThreadsToAwakeCount: %\n", ThreadsToAwakeCount);
-        if(!ReleaseSemaphore(Pool.SemaphoreHandle, ThreadsToAwakeCount, &WorkingThreadCount))
+        graph_task* Continuations[rstd_TaskMaxContinuations];
+        u32 ContinuationCount;
         {
-            ThreadsToAwakeCount = Pool.ThreadCount - WorkingThreadCount;
-            ThreadPoolLog("ReleaseSemaphore 2 - ThreadsToAwakeCount: %, WorkingThreadCount: %\n", ThreadsToAwakeCount, WorkingThreadCount);
-            ReleaseSemaphore(Pool.SemaphoreHandle, ThreadsToAwakeCount, nullptr);
+            rstd_ScopeLock(Task.ContinuationMutex);
+            Task.Closed = true;
+            ContinuationCount = Task.ContinuationCount;
+            rstd_For(ContinuationIndex, ContinuationCount)
+                Continuations[ContinuationIndex] = Task.Continuations[ContinuationIndex];
         }
-#else
-        for(auto Job : Jobs)
-            Job.Callback(Job.CallbackUserData);
-#endif
+        
+        rstd_For(ContinuationIndex, ContinuationCount)
+            InternalReleaseDependency(*Continuations[ContinuationIndex]);
     }
     
-    void CompleteAllJobs
-    (thread_pool& Pool)
+    void Submit(graph_task& Task)
+    { InternalReleaseDependency(Task); }
+    
+    void RunJobsUntilSet
+    (thread_pool& Pool, volatile u32& Flag, io_queue* Queue)
     {
 #if rstd_MultiThreadingEnabled
-        auto& List = Pool.JobList;
-        while(List.NextJobToTake || Pool.RunningJobCount)
+        while(!AtomicLoad<memory_order::Acquire>(Flag))
         {
-            Lock(List.Mutex);
-            auto* Job = PopJob(List);
-            Unlock(List.Mutex);
-            if(Job)
-                Job->Callback(Job->CallbackUserData);
+            thread_pool_job Job;
+            if(Queue && Queue->InFlightCount)
+            {
+                if(!RunCompletion(*Queue, 0))
+                    _mm_pause();
+            }
+            else if(TryPopJob(Pool, Job))
+            {
+                RunJob(Pool, Job);
+            }
+            else
+            {
+                _mm_pause();
+            }
         }
+#else
+        while(!Flag && Queue && Queue->InFlightCount)
+            RunCompletion(*Queue);
+        rstd_AssertM(Flag, "Waiting for a job which was never pushed");
 #endif
     }
     
+    void Wait(graph_task& Task)
+    { RunJobsUntilSet(*Task.Pool, Task.Finished); }
+    
     ///////////
     // FILES //
     ///////////
@@ -6373,13 +8560,13 @@ namespace rstd
         backward_singly_linked_list_with_counter<open_file> OpenFiles;
         mutex Mutex;
         
-        file_debug()
-        { OpenFiles = {OwnArena(rstd_AllocateArenaZero(MegabytesToBytes(1)))}; }
-        
+        // NOTE: The arena is allocated when the first file is opened, so programs don't pay for it on startup
         void OnOpenFile
         (const char* FilePath, void* PlatformFileHandle)
         {
             rstd_ScopeLock(Mutex);
+            if(!OpenFiles.Initialized())
+                OpenFiles = {OwnArena(rstd_AllocateArenaZero(MegabytesToBytes(1)))};
             OpenFiles.Push({FilePath, PlatformFileHandle});
         }
         
@@ -6487,8 +8674,8 @@ namespace rstd
     }
     
     // TODO: Make OpenFile api support control over dwShareMode, dwCreationDisposition, dwFlagsAndAttributes
-    file OpenFile
-    (const char* FilePath, io_mode Mode)
+    file InternalOpenFile
+    (const char* FilePath, io_mode Mode, u32 FlagsAndAttributes)
     {
         file File = {};
         
@@ -6518,7 +8705,7 @@ namespace rstd
         }
         
         File.PlatformFileHandle = ::CreateFileA(FilePath, DesiredAccess,
-                                                FILE_SHARE_READ, 0, CreationDisposition, 0, 0);
+                                                FILE_SHARE_READ, 0, CreationDisposition, FlagsAndAttributes, 0);
         if(File.PlatformFileHandle == INVALID_HANDLE_VALUE)
             File.PlatformFileHandle = nullptr;
         else
@@ -6527,6 +8714,22 @@ namespace rstd
         return File;
     }
     
+    file OpenFile(const char* FilePath, io_mode Mode)
+    { return InternalOpenFile(FilePath, Mode, 0); }
+    
+    file OpenFile
+    (const char* FilePath, io_mode Mode, io_queue& Queue)
+    {
+        auto File = InternalOpenFile(FilePath, Mode, FILE_FLAG_OVERLAPPED);
+        if(File)
+        {
+            File.Async = true;
+            if(!CreateIoCompletionPort(File.PlatformFileHandle, Queue.CompletionPortHandle, 0, 0))
+                Close(File);
+        }
+        return File;
+    }
+    
     rstd_bool Close
     (file& File)
     { 
@@ -6546,48 +8749,102 @@ namespace rstd
         return Overlapped;
     }
     
-    u32 Write
-    (file File, u64 Pos, void* Data, u32 Size)
+    // NOTE: Async files complete with ERROR_IO_PENDING so we wait for the result here.
+    //       The low bit of hEvent keeps the completion packet out of the io_queue.
+    DWORD InternalTransfer
+    (file File, u64 Pos, void* Data, DWORD Size, io_operation Operation)
     {
-        rstd_Assert(File);
-        DWORD WrittenBytes;
+        DWORD TransferredBytes = 0;
         auto Overlapped = MakeOverlapped(Pos);
-        WriteFile(File.PlatformFileHandle, Data, Size, &WrittenBytes, &Overlapped);
-        // TODO: Check if GetLastError returned ERROR_IO_PENDING
-        return WrittenBytes;
+        if(File.Async)
+        {
+            HANDLE EventHandle = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+            rstd_RAssert(EventHandle, "Failed to create an event for a file transfer! Win32 error code: %", GetSystemErrorCode());
+            Overlapped.hEvent = (HANDLE)((uintptr_t)EventHandle | 1);
+        }
+        
+        BOOL Success = Operation == io_operation::Write ?
+            WriteFile(File.PlatformFileHandle, Data, Size, &TransferredBytes, &Overlapped) :
+        ReadFile(File.PlatformFileHandle, Data, Size, &TransferredBytes, &Overlapped);
+        if(!Success && GetLastError() == ERROR_IO_PENDING)
+            GetOverlappedResult(File.PlatformFileHandle, &Overlapped, &TransferredBytes, TRUE);
+        
+        if(File.Async)
+            CloseHandle((HANDLE)((uintptr_t)Overlapped.hEvent & ~(uintptr_t)1));
+        return TransferredBytes;
     }
     
-    u32 Read
-    (void* Dest, file File, u64 Pos, u32 Size)
+    u64 Write
+    (file File, u64 Pos, void* Data, u64 Size)
     {
         rstd_Assert(File);
-        DWORD ReadBytes;
-        auto Overlapped = MakeOverlapped(Pos);
-        ReadFile(File.PlatformFileHandle, Dest, Size, &ReadBytes, &Overlapped);
-        // TODO: Check if GetLastError returned ERROR_IO_PENDING
-        return ReadBytes;
+        u64 WrittenBytesTotal = 0;
+        while(WrittenBytesTotal < Size)
+        {
+            u64 BytesLeft = Size - WrittenBytesTotal;
+            DWORD BytesToWrite = (DWORD)(BytesLeft < MaxBytesPerIoCall ? BytesLeft : MaxBytesPerIoCall);
+            DWORD WrittenBytes = InternalTransfer(File, Pos + WrittenBytesTotal, (u8*)Data + WrittenBytesTotal,
+                                                  BytesToWrite, io_operation::Write);
+            WrittenBytesTotal += WrittenBytes;
+            if(WrittenBytes != BytesToWrite)
+                break;
+        }
+        return WrittenBytesTotal;
+    }
+    
+    u64 Write
+    (file File, void* Data, u64 Size)
+    {
+        rstd_Assert(File);
+        u64 WrittenBytesTotal = 0;
+        while(WrittenBytesTotal < Size)
+        {
+            u64 BytesLeft = Size - WrittenBytesTotal;
+            DWORD BytesToWrite = (DWORD)(BytesLeft < MaxBytesPerIoCall ? BytesLeft : MaxBytesPerIoCall);
+            DWORD WrittenBytes = 0;
+            if(!WriteFile(File.PlatformFileHandle, (u8*)Data + WrittenBytesTotal, BytesToWrite, &WrittenBytes, nullptr))
+                break;
+            WrittenBytesTotal += WrittenBytes;
+        }
+        return WrittenBytesTotal;
+    }
+    
+    u64 Read
+    (void* Dest, file File, u64 Pos, u64 Size)
+    {
+        rstd_Assert(File);
+        u64 ReadBytesTotal = 0;
+        while(ReadBytesTotal < Size)
+        {
+            u64 BytesLeft = Size - ReadBytesTotal;
+            DWORD BytesToRead = (DWORD)(BytesLeft < MaxBytesPerIoCall ? BytesLeft : MaxBytesPerIoCall);
+            DWORD ReadBytes = InternalTransfer(File, Pos + ReadBytesTotal, (u8*)Dest + ReadBytesTotal,
+                                               BytesToRead, io_operation::Read);
+            ReadBytesTotal += ReadBytes;
+            if(ReadBytes != BytesToRead)
+                break;
+        }
+        return ReadBytesTotal;
     }
     
-    // TODO: Add u64 version of this function
     rstd_bool SetFileSize
-    (file File, u32 Size)
+    (file File, u64 Size)
     {
         LARGE_INTEGER FilePointer = {};
-        FilePointer.QuadPart = Size;
+        FilePointer.QuadPart = (LONGLONG)Size;
         auto FileHandle = File.PlatformFileHandle;
         auto Success = SetFilePointerEx(FileHandle, FilePointer, 0, FILE_BEGIN) && SetEndOfFile(FileHandle);
         return (rstd_bool)Success;
     }
     
-    // TODO: Make this function work for size_t
-    u32 GetFileSize
+    u64 GetFileSize
     (file File)
     { 
         LARGE_INTEGER Int;
         if(GetFileSizeEx(File.PlatformFileHandle, &Int))
-            return (u32)Int.QuadPart;
+            return (u64)Int.QuadPart;
         else
-            return InvalidU32;
+            return InvalidU64;
     }
     
     char* ReadWholeFile
@@ -6596,21 +8853,397 @@ namespace rstd
         auto File = OpenFile(FilePath, io_mode::Read);
         rstd_defer(Close(File));
         
-        u32 FileSize = GetFileSize(File);
-        if(FileSize == 0 || FileSize == InvalidU32)
+        u64 FileSize = GetFileSize(File);
+        if(FileSize == 0 || FileSize == InvalidU64)
         {
             return nullptr;
         }
         else
         {
-            void* Content = rstd_PushSizeUninitialized(Arena, FileSize + 1);
-            Read(Content, File, (u32)0, FileSize);
+            void* Content = rstd_PushSizeUninitialized(Arena, (size)FileSize + 1);
+            Read(Content, File, 0, FileSize);
             char* Res = (char*)Content;
             Res[FileSize] = 0;
             return Res;
         }
     }
     
+    void InternalRequestChunk
+    (line_reader& Reader, u32 BufferIndex)
+    {
+        u64 BytesLeft = Reader.EndPos - Reader.ReadPos;
+        Reader.RequestPos = Reader.ReadPos;
+        Reader.RequestSize = BytesLeft < Reader.ChunkSize ? (u32)BytesLeft : Reader.ChunkSize;
+        Reader.RequestBuffer = BufferIndex;
+        Reader.ReadPos += Reader.RequestSize;
+        Reader.ChunkInFlight = true;
+        
+#if rstd_MultiThreadingEnabled
+        SetEvent(Reader.RequestEventHandle);
+#else
+        Reader.RequestReadBytes = (u32)Read(Reader.Buffers[BufferIndex] + Reader.MaxLineLength, Reader.File, Reader.RequestPos, Reader.RequestSize);
+#endif
+    }
+    
+    u32 InternalWaitForChunk
+    (line_reader& Reader)
+    {
+        rstd_Assert(Reader.ChunkInFlight);
+#if rstd_MultiThreadingEnabled
+        WaitForSingleObjectEx(Reader.ReadyEventHandle, INFINITE, FALSE);
+#endif
+        Reader.ChunkInFlight = false;
+        
+        // NOTE: Short read means that the file got shorter or that reading failed, either way we stop there
+        if(Reader.RequestReadBytes != Reader.RequestSize)
+            Reader.ReadPos = Reader.EndPos;
+        
+        return Reader.RequestReadBytes;
+    }
+    
+#if rstd_MultiThreadingEnabled
+    DWORD WINAPI LinePrefetchThreadProc
+    (LPVOID ReaderVoidPtr)
+    {
+        auto& Reader = *(line_reader*)ReaderVoidPtr;
+        for(;;)
+        {
+            WaitForSingleObjectEx(Reader.RequestEventHandle, INFINITE, FALSE);
+            if(Reader.Quit)
+                return 0;
+            
+            char* Dest = Reader.Buffers[Reader.RequestBuffer] + Reader.MaxLineLength;
+            Reader.RequestReadBytes = (u32)Read(Dest, Reader.File, Reader.RequestPos, Reader.RequestSize);
+            SetEvent(Reader.ReadyEventHandle);
+        }
+    }
+#endif
+    
+    void Init
+    (line_reader& Reader, arena& Arena, file File, u64 Pos, u64 EndPos, u32 ChunkSize, u32 MaxLineLength)
+    {
+        rstd_Assert(Pos <= EndPos);
+        Reader = {};
+        Reader.File = File;
+        Reader.ReadPos = Pos;
+        Reader.EndPos = EndPos;
+        Reader.ChunkSize = ChunkSize;
+        Reader.MaxLineLength = MaxLineLength;
+        
+        // NOTE: Every buffer is [carried part of the line | chunk | null terminator of the last line]
+        rstd_For(BufferIndex, 2)
+            Reader.Buffers[BufferIndex] = (char*)rstd_PushSizeUninitialized(Arena, MaxLineLength + ChunkSize + 1);
+        
+        // NOTE: The reader starts on an empty buffer 1 so the first ReadLine() switches to buffer 0
+        Reader.CurrentBuffer = 1;
+        Reader.At = Reader.BufferEnd = Reader.Buffers[1] + MaxLineLength;
+        
+#if rstd_MultiThreadingEnabled
+        Reader.RequestEventHandle = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+        Reader.ReadyEventHandle = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+        Reader.PrefetchThreadHandle = CreateThread(0, 0, LinePrefetchThreadProc, &Reader, 0, nullptr);
+#endif
+        
+        if(Reader.ReadPos < Reader.EndPos)
+            InternalRequestChunk(Reader, 0);
+    }
+    
+    rstd_bool OpenLineReader
+    (line_reader& Reader, arena& Arena, const char* FilePath, u32 ChunkSize, u32 MaxLineLength)
+    {
+        auto File = OpenFile(FilePath, io_mode::Read);
+        if(!File)
+        {
+            Reader = {};
+            return false;
+        }
+        
+        u64 FileSize = GetFileSize(File);
+        Init(Reader, Arena, File, 0, FileSize == InvalidU64 ? 0 : FileSize, ChunkSize, MaxLineLength);
+        Reader.OwnsFile = true;
+        return true;
+    }
+    
+    rstd_bool ReadLine
+    (line_reader& Reader, string_view& Line)
+    {
+        for(;;)
+        {
+            char* LineEnd = (char*)memchr(Reader.At, '\n', (size_t)(Reader.BufferEnd - Reader.At));
+            if(!LineEnd && !Reader.ChunkInFlight)
+            {
+                if(Reader.At == Reader.BufferEnd)
+                    return false;
+                LineEnd = Reader.BufferEnd; // NOTE: The last line doesn't have to end with \n
+            }
+            
+            if(LineEnd)
+            {
+                char* LineStart = Reader.At;
+                Reader.At = LineEnd == Reader.BufferEnd ? LineEnd : LineEnd + 1;
+                if(LineEnd > LineStart && LineEnd[-1] == '\r')
+                    --LineEnd;
+                *LineEnd = 0;
+                Line = string_view(LineStart, (size)(LineEnd - LineStart));
+                return true;
+            }
+            
+            // NOTE: Switch to the chunk which was prefetched and carry the unfinished line in front of it
+            u32 CarriedBytes = (u32)(Reader.BufferEnd - Reader.At);
+            rstd_RAssert(CarriedBytes <= Reader.MaxLineLength, "Line is longer than % characters", Reader.MaxLineLength);
+            
+            u32 NextBuffer = Reader.CurrentBuffer ^ 1;
+            u32 ReadBytes = InternalWaitForChunk(Reader);
+            char* ChunkStart = Reader.Buffers[NextBuffer] + Reader.MaxLineLength;
+            memcpy(ChunkStart - CarriedBytes, Reader.At, CarriedBytes);
+            Reader.At = ChunkStart - CarriedBytes;
+            Reader.BufferEnd = ChunkStart + ReadBytes;
+            Reader.CurrentBuffer = NextBuffer;
+            
+            if(Reader.ReadPos < Reader.EndPos)
+                InternalRequestChunk(Reader, NextBuffer ^ 1);
+        }
+    }
+    
+    void Close
+    (line_reader& Reader)
+    {
+        if(Reader.ChunkInFlight)
+            InternalWaitForChunk(Reader);
+        
+#if rstd_MultiThreadingEnabled
+        if(Reader.PrefetchThreadHandle)
+        {
+            Reader.Quit = true;
+            SetEvent(Reader.RequestEventHandle);
+            WaitForSingleObjectEx(Reader.PrefetchThreadHandle, INFINITE, FALSE);
+            CloseHandle(Reader.PrefetchThreadHandle);
+            CloseHandle(Reader.RequestEventHandle);
+            CloseHandle(Reader.ReadyEventHandle);
+        }
+#endif
+        
+        if(Reader.OwnsFile && Reader.File)
+            Close(Reader.File);
+        Reader = {};
+    }
+    
+    void Init
+    (backward_line_reader& Reader, char* Buffer, file File, u64 Pos, u64 EndPos, u32 WindowSize, u32 MaxLineLength)
+    {
+        rstd_Assert(Pos <= EndPos);
+        Reader = {};
+        Reader.File = File;
+        Reader.StartPos = Pos;
+        Reader.ReadPos = EndPos;
+        Reader.EndPos = EndPos;
+        Reader.WindowSize = WindowSize;
+        Reader.MaxLineLength = MaxLineLength;
+        Reader.Buffer = Buffer;
+        Reader.DataStart = Reader.At = Reader.Buffer + WindowSize;
+        Reader.Finished = Pos == EndPos;
+    }
+    
+    void Init
+    (backward_line_reader& Reader, arena& Arena, file File, u64 Pos, u64 EndPos, u32 WindowSize, u32 MaxLineLength)
+    {
+        char* Buffer = (char*)rstd_PushSizeUninitialized(Arena, WindowSize + MaxLineLength + 1);
+        Init(Reader, Buffer, File, Pos, EndPos, WindowSize, MaxLineLength);
+    }
+    
+    rstd_bool OpenBackwardLineReader
+    (backward_line_reader& Reader, arena& Arena, const char* FilePath, u32 WindowSize, u32 MaxLineLength)
+    {
+        auto File = OpenFile(FilePath, io_mode::Read);
+        if(!File)
+        {
+            Reader = {};
+            return false;
+        }
+        
+        u64 FileSize = GetFileSize(File);
+        Init(Reader, Arena, File, 0, FileSize == InvalidU64 ? 0 : FileSize, WindowSize, MaxLineLength);
+        Reader.OwnsFile = true;
+        return true;
+    }
+    
+    rstd_bool ReadPreviousLine
+    (backward_line_reader& Reader, string_view& Line)
+    {
+        if(Reader.Finished)
+            return false;
+        
+        for(;;)
+        {
+            char* LineStart = Reader.At;
+            while(LineStart > Reader.DataStart && LineStart[-1] != '\n')
+                --LineStart;
+            
+            rstd_bool NoMoreData = Reader.ReadPos == Reader.StartPos;
+            if(LineStart > Reader.DataStart || NoMoreData)
+            {
+                char* LineEnd = Reader.At;
+                if(LineEnd > LineStart && LineEnd[-1] == '\r')
+                    --LineEnd;
+                *LineEnd = 0;
+                Line = string_view(LineStart, (size)(LineEnd - LineStart));
+                
+                if(LineStart > Reader.DataStart)
+                    Reader.At = LineStart - 1;
+                else
+                    Reader.Finished = true;
+                return true;
+            }
+            
+            // NOTE: Move the unfinished line behind the window and read the window which precedes it
+            u32 CarriedBytes = (u32)(Reader.At - Reader.DataStart);
+            rstd_RAssert(CarriedBytes <= Reader.MaxLineLength, "Line is longer than % characters", Reader.MaxLineLength);
+            char* WindowEnd = Reader.Buffer + Reader.WindowSize;
+            memmove(WindowEnd, Reader.DataStart, CarriedBytes);
+            
+            u64 BytesLeft = Reader.ReadPos - Reader.StartPos;
+            u32 WindowBytes = BytesLeft < Reader.WindowSize ? (u32)BytesLeft : Reader.WindowSize;
+            u64 WindowPos = Reader.ReadPos - WindowBytes;
+            
+            // NOTE: Short read means that the file got shorter or that reading failed, either way we stop there
+            u64 ReadBytes = Read(WindowEnd - WindowBytes, Reader.File, WindowPos, WindowBytes);
+            Reader.ReadPos = ReadBytes == WindowBytes ? WindowPos : Reader.StartPos;
+            Reader.DataStart = ReadBytes == WindowBytes ? WindowEnd - WindowBytes : WindowEnd;
+            Reader.At = WindowEnd + CarriedBytes;
+            
+            // NOTE: Like in line_reader, a \n at the end of the file doesn't start another (empty) line
+            if(WindowPos + WindowBytes == Reader.EndPos && Reader.At > Reader.DataStart && Reader.At[-1] == '\n')
+                --Reader.At;
+        }
+    }
+    
+    void Close
+    (backward_line_reader& Reader)
+    {
+        if(Reader.OwnsFile && Reader.File)
+            Close(Reader.File);
+        Reader = {};
+    }
+    
+    //////////////
+    // ASYNC IO //
+    //////////////
+    static_assert(sizeof(OVERLAPPED) <= sizeof(io_request::PlatformOverlapped), "io_request can't hold OVERLAPPED");
+    
+    // NOTE: Completion key of the packets posted by the fallback, their results are already in the request
+    constexpr ULONG_PTR FallbackCompletionKey = 1;
+    
+    static io_request* InternalGetRequest(OVERLAPPED* Overlapped)
+    { return (io_request*)((u8*)Overlapped - offsetof(io_request, PlatformOverlapped)); }
+    
+    void Init
+    (io_queue& Queue, thread_pool* FallbackPool)
+    {
+        Queue = {};
+        Queue.CompletionPortHandle = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 0);
+        Queue.FallbackPool = FallbackPool;
+        rstd_RAssert(Queue.CompletionPortHandle, "Failed to create IO completion port! Win32 error code: %", GetSystemErrorCode());
+    }
+    
+    void Close
+    (io_queue& Queue)
+    {
+        while(Queue.InFlightCount)
+            WaitForCompletion(Queue);
+        CloseHandle(Queue.CompletionPortHandle);
+        Queue = {};
+    }
+    
+    static void InternalRunFallbackRequest
+    (void* RequestVoidPtr)
+    {
+        auto& Request = *(io_request*)RequestVoidPtr;
+        u64 TransferredBytes = Request.Operation == io_operation::Write ?
+            Write(Request.File, Request.Pos, Request.Buffer, Request.Size) :
+        Read(Request.Buffer, Request.File, Request.Pos, Request.Size);
+        Request.TransferredBytes = (u32)TransferredBytes;
+        Request.Succeeded = TransferredBytes == Request.Size;
+        PostQueuedCompletionStatus(Request.Queue->CompletionPortHandle, Request.TransferredBytes,
+                                   FallbackCompletionKey, (OVERLAPPED*)Request.PlatformOverlapped);
+    }
+    
+    rstd_bool Submit
+    (io_queue& Queue, io_request& Request)
+    {
+        rstd_Assert(Request.File);
+        Request.Queue = &Queue;
+        Request.TransferredBytes = 0;
+        Request.Succeeded = false;
+        auto* Overlapped = (OVERLAPPED*)Request.PlatformOverlapped;
+        *Overlapped = MakeOverlapped(Request.Pos);
+        AtomicIncrement(Queue.InFlightCount);
+        
+        if(Request.File.Async)
+        {
+            // NOTE: The completion packet is queued even if the call finishes right away
+            BOOL Success = Request.Operation == io_operation::Write ?
+                WriteFile(Request.File.PlatformFileHandle, Request.Buffer, Request.Size, nullptr, Overlapped) :
+            ReadFile(Request.File.PlatformFileHandle, Request.Buffer, Request.Size, nullptr, Overlapped);
+            if(!Success && GetLastError() != ERROR_IO_PENDING)
+            {
+                AtomicDecrement(Queue.InFlightCount);
+                return false;
+            }
+        }
+        else if(Queue.FallbackPool)
+        {
+            PushJob(*Queue.FallbackPool, &Request, InternalRunFallbackRequest);
+        }
+        else
+        {
+            InternalRunFallbackRequest(&Request);
+        }
+        return true;
+    }
+    
+    io_request* WaitForCompletion
+    (io_queue& Queue, u32 TimeoutInMilliseconds)
+    {
+        DWORD TransferredBytes = 0;
+        ULONG_PTR CompletionKey = 0;
+        OVERLAPPED* Overlapped = nullptr;
+        DWORD Timeout = TimeoutInMilliseconds == InvalidU32 ? INFINITE : TimeoutInMilliseconds;
+        BOOL Success = GetQueuedCompletionStatus(Queue.CompletionPortHandle, &TransferredBytes,
+                                                 &CompletionKey, &Overlapped, Timeout);
+        if(!Overlapped)
+            return nullptr;
+        
+        auto* Request = InternalGetRequest(Overlapped);
+        if(CompletionKey != FallbackCompletionKey)
+        {
+            // NOTE: Reading past the end of the file fails with ERROR_HANDLE_EOF, that's just a short read for us
+            Request->TransferredBytes = TransferredBytes;
+            Request->Succeeded = Success && TransferredBytes == Request->Size;
+        }
+        AtomicDecrement(Queue.InFlightCount);
+        return Request;
+    }
+    
+    rstd_bool RunCompletion
+    (io_queue& Queue, u32 TimeoutInMilliseconds)
+    {
+        auto* Request = WaitForCompletion(Queue, TimeoutInMilliseconds);
+        if(!Request)
+            return false;
+        
+        if(Request->Callback)
+            Request->Callback(*Request);
+        return true;
+    }
+    
+    file GetStandardOutput()
+    {
+        file File = {GetStdHandle(STD_OUTPUT_HANDLE)};
+        if(File.PlatformFileHandle == INVALID_HANDLE_VALUE)
+            File.PlatformFileHandle = nullptr;
+        return File;
+    }
+    
     rstd_bool CreateDirectory(const char* Path)
     { return ::CreateDirectoryA(Path, nullptr); }
     
@@ -6702,18 +9335,252 @@ namespace rstd
         return ConvertToTime(St);
     }
     
-    u64 GetSystemTimeAsUnixEpoch()
+    // NOTE: Rules with wYear == 0 mean "wDay-th wDayOfWeek of wMonth" where wDay == 5 is the last one
+    static i64 InternalGetTransitionLocalSeconds
+    (SYSTEMTIME& Rule, u32 Year)
+    {
+        u32 Day = Rule.wDay;
+        if(Rule.wYear == 0)
+        {
+            i64 FirstOfMonth = DaysFromCivil(Year, Rule.wMonth, 1);
+            i64 FirstOfNextMonth = Rule.wMonth == 12 ? DaysFromCivil(Year + 1, 1, 1) : DaysFromCivil(Year, Rule.wMonth + 1, 1);
+            u32 FirstWeekDay = (u32)((FirstOfMonth % 7 + 7 + 4) % 7); // NOTE: 1970-01-01 was Thursday, 0 is Sunday like in wDayOfWeek
+            Day = 1 + (Rule.wDayOfWeek + 7 - FirstWeekDay) % 7 + (Rule.wDay - 1) * 7;
+            while(Day > (u32)(FirstOfNextMonth - FirstOfMonth))
+                Day -= 7;
+        }
+        return DaysFromCivil(Year, Rule.wMonth, Day) * SecondsPerDay +
+            Rule.wHour * SecondsPerHour + Rule.wMinute * SecondsPerMinute + Rule.wSecond;
+    }
+    
+    time_zone_table BuildTimeZoneTable
+    (arena& Arena, u32 FirstYear, u32 LastYear)
+    {
+        if(LastYear < FirstYear)
+            LastYear = FirstYear;
+        
+        time_zone_table Table;
+        Table.Transitions = rstd_PushArrayUninitialized(Arena, time_zone_transition, 1 + 2 * (LastYear - FirstYear + 1));
+        Table.Count = 0;
+        auto PushTransition = [&](i64 UtcStart, i32 OffsetInSeconds)
+        { Table.Transitions[Table.Count++] = {UtcStart, OffsetInSeconds}; };
+        
+        for(u32 Year = FirstYear; Year <= LastYear; ++Year)
+        {
+            TIME_ZONE_INFORMATION Info;
+            if(!GetTimeZoneInformationForYear((USHORT)Year, nullptr, &Info))
+                continue;
+            
+            // NOTE: Win32 biases are in minutes and go the other way (utc = local + bias)
+            i32 StandardOffset = -(i32)(Info.Bias + Info.StandardBias) * (i32)SecondsPerMinute;
+            i32 DaylightOffset = -(i32)(Info.Bias + Info.DaylightBias) * (i32)SecondsPerMinute;
+            i64 YearStart = DaysFromCivil(Year, 1, 1) * SecondsPerDay;
+            
+            if(Info.DaylightDate.wMonth == 0 || Info.StandardDate.wMonth == 0)
+            {
+                PushTransition(Table.Count ? YearStart - StandardOffset : MinI64, StandardOffset);
+                continue;
+            }
+            
+            // NOTE: Daylight time starts at local standard time and ends at local daylight time
+            i64 DaylightStart = InternalGetTransitionLocalSeconds(Info.DaylightDate, Year) - StandardOffset;
+            i64 DaylightEnd = InternalGetTransitionLocalSeconds(Info.StandardDate, Year) - DaylightOffset;
+            if(DaylightStart < DaylightEnd)
+            {
+                if(!Table.Count)
+                    PushTransition(MinI64, StandardOffset);
+                PushTransition(DaylightStart, DaylightOffset);
+                PushTransition(DaylightEnd, StandardOffset);
+            }
+            else
+            {
+                // NOTE: Southern hemisphere, the year starts in daylight time
+                if(!Table.Count)
+                    PushTransition(MinI64, DaylightOffset);
+                PushTransition(DaylightEnd, StandardOffset);
+                PushTransition(DaylightStart, DaylightOffset);
+            }
+        }
+        
+        if(!Table.Count)
+            PushTransition(MinI64, 0);
+        return Table;
+    }
+    
+    u64 GetSystemTimeAsUnixEpoch()
+    {
+        union file_time 
+        {
+            FILETIME FileTime;
+            u64 U64;
+        };
+        file_time Res;
+        GetSystemTimeAsFileTime(&Res.FileTime);
+        u64 DifferenceBetweenWindowsEpochAndUnixEpoch = 116444736000000000;
+        Res.U64 -= DifferenceBetweenWindowsEpochAndUnixEpoch;
+        return Res.U64;
+    }
+    
+    ///////////////////
+    // INTERVAL SUMS //
+    ///////////////////
+    static rstd_bool InternalCpuHasAvx2()
+    {
+        int Info[4];
+        __cpuid(Info, 1);
+        rstd_bool OsSavesYmmRegisters = (Info[2] & (1 << 27)) && (Info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+        if(!OsSavesYmmRegisters)
+            return false;
+        __cpuidex(Info, 7, 0);
+        return (Info[1] & (1 << 5)) != 0;
+    }
+    
+    static void InternalSumEvenAndOddScalar
+    (const u64* Times, u32 Count, u64* EvenSum, u64* OddSum)
+    {
+        for(u32 Index = 0; Index < Count; Index += 2)
+        {
+            *EvenSum += Times[Index];
+            *OddSum += Times[Index + 1];
+        }
+    }
+    
+    // NOTE: Lanes 0 and 2 hold even elements, lanes 1 and 3 odd ones
+    static void InternalSumEvenAndOddAvx2
+    (const u64* Times, u32 Count, u64* EvenSum, u64* OddSum)
+    {
+        __m256i SumsA = _mm256_setzero_si256();
+        __m256i SumsB = _mm256_setzero_si256();
+        u32 Index = 0;
+        for(; Index + 8 <= Count; Index += 8)
+        {
+            SumsA = _mm256_add_epi64(SumsA, _mm256_loadu_si256((const __m256i*)(Times + Index)));
+            SumsB = _mm256_add_epi64(SumsB, _mm256_loadu_si256((const __m256i*)(Times + Index + 4)));
+        }
+        
+        u64 Lanes[4];
+        _mm256_storeu_si256((__m256i*)Lanes, _mm256_add_epi64(SumsA, SumsB));
+        *EvenSum += Lanes[0] + Lanes[2];
+        *OddSum += Lanes[1] + Lanes[3];
+        InternalSumEvenAndOddScalar(Times + Index, Count - Index, EvenSum, OddSum);
+    }
+    
+    alternating_interval_sums SumAlternatingIntervals
+    (const u64* Times, u32 Count, u64 OpenEnd)
+    {
+        alternating_interval_sums Res = {};
+        if(Count == 0)
+            return Res;
+        
+        static rstd_bool HasAvx2 = InternalCpuHasAvx2();
+        
+        // NOTE: Over the full pairs the intervals starting at even indices sum up to (sum of odd times - sum of even times)
+        //       and the odd ones are the rest of the whole span. The sums can wrap around but the differences are right.
+        u64 EvenSum = 0, OddSum = 0;
+        u32 PairedCount = Count & ~1u;
+        if(HasAvx2)
+            InternalSumEvenAndOddAvx2(Times, PairedCount, &EvenSum, &OddSum);
+        else
+            InternalSumEvenAndOddScalar(Times, PairedCount, &EvenSum, &OddSum);
+        
+        u32 LastIndex = Count - 1;
+        Res.EvenSum = OddSum - EvenSum;
+        Res.OddSum = (Times[LastIndex] - Times[0]) - Res.EvenSum;
+        if(LastIndex % 2 == 0)
+            Res.EvenSum += OpenEnd - Times[LastIndex];
+        else
+            Res.OddSum += OpenEnd - Times[LastIndex];
+        return Res;
+    }
+    
+    /////////////////////
+    // TIMING PROFILER //
+    /////////////////////
+#if rstd_TimingProfilerEnabled
+    static thread_local timing_thread_buffer* TimingThreadBuffer;
+    static timing_thread_buffer* TimingThreadBuffers;
+    static mutex TimingThreadBuffersMutex;
+    
+    // NOTE: Taken when the first zone of any thread begins, the trace starts there and they're used to get the rdtsc frequency
+    static u64 TimingStartTsc;
+    static i64 TimingStartPerformanceCounter;
+    
+    static timing_thread_buffer* InternalRegisterTimingThread()
+    {
+        auto* Buffer = (timing_thread_buffer*)PageAlloc(sizeof(timing_thread_buffer) +
+                                                        rstd_TimingProfilerEventsPerThread * sizeof(timing_event));
+        rstd_RAssert(Buffer, "OS Allocation call failed (probably your machine ran out of memory)");
+        Buffer->Events = (timing_event*)(Buffer + 1);
+        Buffer->ThreadId = GetThreadID();
+        
+        rstd_ScopeLock(TimingThreadBuffersMutex);
+        if(!TimingThreadBuffers)
+        {
+            LARGE_INTEGER Counter;
+            QueryPerformanceCounter(&Counter);
+            TimingStartPerformanceCounter = Counter.QuadPart;
+            TimingStartTsc = __rdtsc();
+        }
+        Buffer->Next = TimingThreadBuffers;
+        TimingThreadBuffers = Buffer;
+        return Buffer;
+    }
+    
+    u64 BeginTimingZone()
+    {
+        if(!TimingThreadBuffer)
+            TimingThreadBuffer = InternalRegisterTimingThread();
+        return __rdtsc();
+    }
+    
+    void RecordTimingEvent
+    (const char* Name, u64 BeginTsc, u64 EndTsc)
+    {
+        static_assert((rstd_TimingProfilerEventsPerThread & (rstd_TimingProfilerEventsPerThread - 1)) == 0,
+                      "rstd_TimingProfilerEventsPerThread has to be a power of 2");
+        
+        auto* Buffer = TimingThreadBuffer;
+        if(!Buffer)
+            Buffer = TimingThreadBuffer = InternalRegisterTimingThread();
+        
+        auto& Event = Buffer->Events[Buffer->EventCount++ & (rstd_TimingProfilerEventsPerThread - 1)];
+        Event.Name = Name;
+        Event.BeginTsc = BeginTsc;
+        Event.EndTsc = EndTsc;
+    }
+#endif
+    
+    rstd_bool WriteTimingTrace
+    (arena& Arena, const char* FilePath)
     {
-        union file_time 
+#if rstd_TimingProfilerEnabled
+        auto Stream = OpenFileStream(FilePath, io_mode::Write, Arena);
+        if(!Stream)
+            return false;
+        
+        f64 TscPerMicrosecond = InternalGetTscPerMicrosecond(TimingStartTsc, TimingStartPerformanceCounter);
+        
+        WriteString(Stream, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+        rstd_bool FirstEvent = true;
+        for(auto* Buffer = TimingThreadBuffers; Buffer; Buffer = Buffer->Next)
         {
-            FILETIME FileTime;
-            u64 U64;
-        };
-        file_time Res;
-        GetSystemTimeAsFileTime(&Res.FileTime);
-        u64 DifferenceBetweenWindowsEpochAndUnixEpoch = 116444736000000000;
-        Res.U64 -= DifferenceBetweenWindowsEpochAndUnixEpoch;
-        return Res.U64;
+            u64 FirstKept = Buffer->EventCount > rstd_TimingProfilerEventsPerThread ?
+                Buffer->EventCount - rstd_TimingProfilerEventsPerThread : 0;
+            for(u64 EventIndex = FirstKept; EventIndex < Buffer->EventCount; ++EventIndex)
+            {
+                auto& Event = Buffer->Events[EventIndex & (rstd_TimingProfilerEventsPerThread - 1)];
+                f64 Begin = (f64)(i64)(Event.BeginTsc - TimingStartTsc) / TscPerMicrosecond;
+                f64 Duration = (f64)(Event.EndTsc - Event.BeginTsc) / TscPerMicrosecond;
+                WriteString(Stream, "%\n{\"name\":\"%\",\"ph\":\"X\",\"pid\":0,\"tid\":%,\"ts\":%,\"dur\":%}",
+                            FirstEvent ? "" : ",", Event.Name, Buffer->ThreadId, ToString(Begin, 3), ToString(Duration, 3));
+                FirstEvent = false;
+            }
+        }
+        WriteString(Stream, "\n]}\n");
+        return Close(Stream);
+#else
+        return false;
+#endif
     }
     
 #endif // _WIN32
@@ -6722,292 +9589,573 @@ namespace rstd
     //////////////////
     // MEMORY DEBUG //
     //////////////////
+    // NOTE: Allocations are aggregated into counters per callsite (file, line, memory group and allocation type).
+    //       Callsites, arenas, memory groups and live malloc allocations are found through hash tables,
+    //       so registering an allocation doesn't depend on how many allocations were made before.
+    //       Arena pushes are counted by the pushing thread in its own callsite table without taking State.Mutex,
+    //       WriteReport() merges the tables. Creating arenas and blocks, malloc and free still take the mutex.
+    //       Define rstd_MemoryProfilerRecordAllocations to 1 to also keep a record of every allocation.
     namespace MemoryDebug
     {
         struct statistics
         {
-            u32
+            size
                 Used, UsedPeak,
             Size, SizePeak,
             Wasted, Unused;
         };
         
+        // NOTE: Open addressing table which maps hashes to indices into a bucket_array.
+        //       Different keys can have the same hash, so lookups check the element at the index.
+        struct index_table_slot
+        {
+            u64 Hash;
+            u32 Index;
+        };
+        
+        struct index_table
+        {
+            index_table_slot* Slots;
+            u32 Capacity;
+            u32 Count;
+        };
+        
+        static u64 Hash
+        (u64 Key)
+        {
+            // NOTE: splitmix64 finalizer
+            Key ^= Key >> 30;
+            Key *= 0xbf58476d1ce4e5b9ull;
+            Key ^= Key >> 27;
+            Key *= 0x94d049bb133111ebull;
+            Key ^= Key >> 31;
+            return Key;
+        }
+        
+        static u64 Hash(const void* Key)
+        { return Hash((u64)Key); }
+        
+        static void InternalGrow
+        (index_table& Table)
+        {
+            u32 NewCapacity = Table.Capacity ? Table.Capacity * 2 : 1024;
+            auto* NewSlots = (index_table_slot*)PageAlloc(NewCapacity * sizeof(index_table_slot));
+            rstd_RAssert(NewSlots, "Memory profiler failed to allocate hash table");
+            rstd_For(SlotIndex, NewCapacity)
+                NewSlots[SlotIndex].Index = InvalidU32;
+            
+            rstd_For(SlotIndex, Table.Capacity)
+            {
+                auto& Slot = Table.Slots[SlotIndex];
+                if(Slot.Index != InvalidU32)
+                {
+                    u32 At = (u32)Slot.Hash & (NewCapacity - 1);
+                    while(NewSlots[At].Index != InvalidU32)
+                        At = (At + 1) & (NewCapacity - 1);
+                    NewSlots[At] = Slot;
+                }
+            }
+            
+            if(Table.Slots)
+                PageFree(Table.Slots);
+            Table.Slots = NewSlots;
+            Table.Capacity = NewCapacity;
+        }
+        
+        // NOTE: Returns the index for which Matches(Index) returned true or InvalidU32
+        template<class matches> static u32 FindIndex
+        (index_table& Table, u64 KeyHash, matches Matches)
+        {
+            if(!Table.Capacity)
+                return InvalidU32;
+            
+            for(u32 At = (u32)KeyHash & (Table.Capacity - 1);; At = (At + 1) & (Table.Capacity - 1))
+            {
+                auto& Slot = Table.Slots[At];
+                if(Slot.Index == InvalidU32)
+                    return InvalidU32;
+                if(Slot.Hash == KeyHash && Matches(Slot.Index))
+                    return Slot.Index;
+            }
+        }
+        
+        static void AddIndex
+        (index_table& Table, u64 KeyHash, u32 Index)
+        {
+            if((Table.Count + 1) * 10 > Table.Capacity * 7)
+                InternalGrow(Table);
+            
+            u32 At = (u32)KeyHash & (Table.Capacity - 1);
+            while(Table.Slots[At].Index != InvalidU32)
+                At = (At + 1) & (Table.Capacity - 1);
+            Table.Slots[At] = {KeyHash, Index};
+            ++Table.Count;
+        }
+        
         struct arena_debug_data
         {
-            doubly_linked_list<memory_block> MemoryBlocks;
+            allocator_name NamelessName;
             const char* Name;
             const char* MasterArenaName;
             statistics Stats;
             calling_info CreationCallingInfo;
-            rstd_bool HasNamelessName;
+            u32 MemoryGroupId;
+            u32 MemoryBlockCount;
             rstd_bool TemporaryMemory;
+            rstd_bool Deallocated;
         };
         
-        struct allocation
+        // NOTE: The same group name can come from different string literals.
+        //       Every name pointer gets its own entry which points to the interned group.
+        struct memory_group_name
+        {
+            const char* Name;
+            u32 MemoryGroupId;
+        };
+        
+        struct callsite
         {
             calling_info CallingInfo;
-            const char* AllocatorName;
-            void* Memory;
-            u32 Size;
+            u32 MemoryGroupId;
             allocation_type Type;
+            u64 Count;
+            u64 FreeCount;
+            u64 Bytes;
+            u64 LiveBytes;
+            u64 PeakLiveBytes;
         };
         
-        struct deallocation
+        struct callsite_table
         {
-            void* Memory;
-            allocation_type Type;
+            bucket_array<callsite> Callsites;
+            index_table Table;
         };
         
-        struct memory_group
+        // NOTE: Arena debug data doesn't move, so threads keep pointers to it. Generation is the ArenaGeneration
+        //       of the state when the pointer was looked up, an arena with the same name can come after it.
+        struct cached_arena_debug
         {
-            doubly_linked_list_with_counter<arena_debug_data> Arenas;
-            doubly_linked_list<allocation> Allocations;
-            doubly_linked_list<deallocation> Deallocations;
-            const char* Name;
+            const char* DebugName;
+            arena_debug_data* ArenaDebug;
+            u32 Generation;
+        };
+        
+        // NOTE: Stays after its thread exits, so the report still has its pushes
+        struct thread_state
+        {
+            arena Arena;
+            callsite_table Callsites;
+            bucket_array<cached_arena_debug> Arenas;
+            index_table ArenaTable;
+            thread_state* Next;
         };
         
+        struct live_allocation
+        {
+            void* Memory;
+            size Size;
+            u32 CallsiteIndex;
+            rstd_bool Live;
+        };
+
+#if rstd_MemoryProfilerRecordAllocations
+        struct allocation
+        {
+            calling_info CallingInfo;
+            const char* AllocatorName;
+            void* Memory;
+            size Size;
+            allocation_type Type;
+            u32 MemoryGroupId;
+        };
+#endif
+
         struct state
         {
             arena Arena;
-            doubly_linked_list<memory_group> MemoryGroups;
-            doubly_linked_list<allocator_name> NamelessAllocatorNames;
+            mutex Mutex;
+            bucket_array<const char*, 64> MemoryGroups;
+            bucket_array<memory_group_name, 64> MemoryGroupNames;
+            bucket_array<arena_debug_data, 64> Arenas;
+            callsite_table GenAllocCallsites;
+            bucket_array<live_allocation> LiveAllocations;
+#if rstd_MemoryProfilerRecordAllocations
+            bucket_array<allocation> Allocations;
+#endif
+            index_table MemoryGroupNameTable;
+            index_table ArenaTable;
+            index_table LiveAllocationTable;
             statistics Stats;
-            memory_group* OthersMemoryGroup;
-            memory_group* CurrentMemoryGroup;
-            u32 NextArenaDebugId;
-            u32 NamelessAllocatorIndex;
-            rstd_bool JustCalledNextAllocationMemoryGroup;
+            thread_state* ThreadStates;
+            volatile u32 ArenaGeneration; // NOTE: Incremented when an arena is created or deallocated
             rstd_bool RegisterAllocations;
         };
         
         global state State;
+        static thread_local thread_state* ThreadState;
+        
+        // NOTE: Memory groups are per thread, so a group begun on one thread doesn't take allocations of the others
+        static thread_local u32 CurrentMemoryGroupId;
+        static thread_local rstd_bool JustCalledNextAllocationMemoryGroup;
         
-        struct scope_no_alloc_registration
+        // NOTE: Set while the profiler is working, so its own allocations aren't registered
+        static thread_local rstd_bool InsideRegistration;
+        
+        // NOTE: For work on the tables of the thread, it only keeps the profiler's own allocations from being registered
+        struct scope_thread_registration
+        {
+            rstd_bool Entered;
+            
+            scope_thread_registration()
+            {
+                Entered = State.RegisterAllocations && !InsideRegistration;
+                if(Entered)
+                    InsideRegistration = true;
+            }
+            
+            ~scope_thread_registration()
+            {
+                if(Entered)
+                    InsideRegistration = false;
+            }
+        };
+        
+        struct scope_registration
         {
-            scope_no_alloc_registration()
-            { State.RegisterAllocations = false; }
+            rstd_bool Entered;
+            
+            scope_registration()
+            {
+                Entered = State.RegisterAllocations && !InsideRegistration;
+                if(Entered)
+                {
+                    InsideRegistration = true;
+                    Lock(State.Mutex);
+                }
+            }
             
-            ~scope_no_alloc_registration()
-            { State.RegisterAllocations = true; }
+            ~scope_registration()
+            {
+                if(Entered)
+                {
+                    Unlock(State.Mutex);
+                    InsideRegistration = false;
+                }
+            }
         };
         
-#define ScopeNoAllocRegistration scope_no_alloc_registration ScopeNoAllocRegis
+        constexpr u32 OthersMemoryGroupId = 0;
         
-        memory_group* AddMemoryGroup
+        static u32 InternMemoryGroup
         (const char* Name)
         {
-            ScopeNoAllocRegistration;
-            auto& MemoryGroup = State.MemoryGroups.PushUninitialized();
-            MemoryGroup.Name = Name;
-            MemoryGroup.Arenas = ShareArena(State.Arena);
-            MemoryGroup.Allocations = ShareArena(State.Arena);
-            MemoryGroup.Deallocations = ShareArena(State.Arena);
-            return &MemoryGroup;
+            u64 NameHash = Hash(Name);
+            u32 NameIndex = FindIndex(State.MemoryGroupNameTable, NameHash,
+                                      [=](u32 Index){ return State.MemoryGroupNames[Index].Name == Name; });
+            if(NameIndex != InvalidU32)
+                return State.MemoryGroupNames[NameIndex].MemoryGroupId;
+            
+            u32 MemoryGroupId = InvalidU32;
+            rstd_For(GroupId, State.MemoryGroups.Count)
+            {
+                if(strcmp(State.MemoryGroups[GroupId], Name) == 0)
+                {
+                    MemoryGroupId = GroupId;
+                    break;
+                }
+            }
+            
+            if(MemoryGroupId == InvalidU32)
+            {
+                MemoryGroupId = State.MemoryGroups.Count;
+                State.MemoryGroups.Push(Name);
+            }
+            
+            AddIndex(State.MemoryGroupNameTable, NameHash, State.MemoryGroupNames.Count);
+            State.MemoryGroupNames.Push({Name, MemoryGroupId});
+            return MemoryGroupId;
         }
         
         void Init()
         {
-            ScopeNoAllocRegistration;
+            InsideRegistration = true;
             State.Arena = AllocateArenaZero(MegabytesToBytes(2), "Memory debug");
-            State.MemoryGroups = ShareArena(State.Arena);
-            State.NamelessAllocatorNames = ShareArena(State.Arena);
-            State.OthersMemoryGroup = AddMemoryGroup("Others");
-            State.CurrentMemoryGroup = State.OthersMemoryGroup;
+            State.MemoryGroups.Init(ShareArena(State.Arena));
+            State.MemoryGroupNames.Init(ShareArena(State.Arena));
+            State.Arenas.Init(ShareArena(State.Arena));
+            State.GenAllocCallsites.Callsites.Init(ShareArena(State.Arena));
+            State.LiveAllocations.Init(ShareArena(State.Arena));
+#if rstd_MemoryProfilerRecordAllocations
+            State.Allocations.Init(ShareArena(State.Arena));
+#endif
+            InternMemoryGroup("Others");
+            CurrentMemoryGroupId = OthersMemoryGroupId;
+            InsideRegistration = false;
             State.RegisterAllocations = true;
         }
         
         void BeginMemoryGroup
         (const char* Name)
         {
-            auto* MemoryGroup = Find(State.MemoryGroups, [=]
-                                     (auto Group){ return strcmp(Group.Name, Name) == 0; });
-            
-            if(!MemoryGroup)
-                MemoryGroup = AddMemoryGroup(Name);
-            
-            State.CurrentMemoryGroup = MemoryGroup;
+            scope_registration Registration;
+            if(Registration.Entered)
+                CurrentMemoryGroupId = InternMemoryGroup(Name);
         }
         
         void EndMemoryGroup()
-        { State.CurrentMemoryGroup = State.OthersMemoryGroup; }
+        { CurrentMemoryGroupId = OthersMemoryGroupId; }
         
         void NextCallMemoryGroup
         (const char* Name)
         {
             BeginMemoryGroup(Name);
-            State.JustCalledNextAllocationMemoryGroup = true;
+            JustCalledNextAllocationMemoryGroup = true;
         }
         
         struct scope_memory_group
         {
-            scope_memory_group(char* Name)
+            scope_memory_group(const char* Name)
             { BeginMemoryGroup(Name); }
             
             ~scope_memory_group()
             { EndMemoryGroup(); }
         };
-        
-#define ScopeMemoryGroup(_Name) scope_memory_group ScopeMemGroup##__LINE__(_Name)
-        
+
+#define ScopeMemoryGroup(_Name) scope_memory_group rstd_LineName(ScopeMemGroup)(_Name)
+
         static void EndNextCallMemoryGroup()
         {
-            if(State.JustCalledNextAllocationMemoryGroup)
+            if(JustCalledNextAllocationMemoryGroup)
             {
-                State.JustCalledNextAllocationMemoryGroup = false;
-                State.CurrentMemoryGroup = State.OthersMemoryGroup;
+                JustCalledNextAllocationMemoryGroup = false;
+                CurrentMemoryGroupId = OthersMemoryGroupId;
             }
         }
         
+        // NOTE: Pushes change statistics without State.Mutex, so every change is atomic
+        static void AddToStatistic
+        (size* Statistic, size Delta)
+        { AtomicFetchAdd(*Statistic, Delta); }
+        
+        static void SubtractFromStatistic
+        (size* Statistic, size Delta)
+        { AtomicFetchAdd(*Statistic, 0 - Delta); }
+        
         static void AddStatistic
-        (u32* Statistic, u32* MaxStatistic, u32 Delta)
+        (size* Statistic, size* MaxStatistic, size Delta)
         {
-            *Statistic += Delta;
-            if(*Statistic > *MaxStatistic)
-                *MaxStatistic = *Statistic;
+            size NewValue = AtomicFetchAdd(*Statistic, Delta) + Delta;
+            size MaxValue = AtomicLoad<memory_order::Relaxed>(*MaxStatistic);
+            while(NewValue > MaxValue)
+            {
+                size PreviousMax = AtomicCompareExchange<memory_order::Relaxed>(*MaxStatistic, NewValue, MaxValue);
+                if(PreviousMax == MaxValue)
+                    break;
+                MaxValue = PreviousMax;
+            }
         }
         
         static void AddUsedAndSubtractUnused
-        (statistics* Stats, u32 Delta)
+        (statistics* Stats, size Delta)
         {
             AddStatistic(&Stats->Used, &Stats->UsedPeak, Delta);
-            Stats->Unused -= Delta;
+            SubtractFromStatistic(&Stats->Unused, Delta);
         }
         
         static void AddSizeAndUnused
-        (statistics* Stats, u32 Delta)
-        { 
+        (statistics* Stats, size Delta)
+        {
             AddStatistic(&Stats->Size, &Stats->SizePeak, Delta);
-            Stats->Unused += Delta;
+            AddToStatistic(&Stats->Unused, Delta);
         }
         
         static void SubtractUsedAndAddUnused
-        (statistics* Stats, u32 Delta)
-        { 
-            Stats->Used -= Delta;
-            Stats->Unused += Delta;
+        (statistics* Stats, size Delta)
+        {
+            SubtractFromStatistic(&Stats->Used, Delta);
+            AddToStatistic(&Stats->Unused, Delta);
         }
         
         static void SubtractSizeAndUnused
-        (statistics* Stats, u32 SizeDelta, u32 UnusedDelta)
-        { 
-            Stats->Size -= SizeDelta; 
-            Stats->Unused -= UnusedDelta;
+        (statistics* Stats, size SizeDelta, size UnusedDelta)
+        {
+            SubtractFromStatistic(&Stats->Size, SizeDelta);
+            SubtractFromStatistic(&Stats->Unused, UnusedDelta);
         }
         
         static void AlterStatsOnMemoryBlockAllocation
-        (statistics* Stats, u32 NewMemoryBlockSize, u32 PrevMemoryBlockUnusedBytes)
+        (statistics* Stats, size NewMemoryBlockSize, size PrevMemoryBlockUnusedBytes)
         {
             AddSizeAndUnused(Stats, NewMemoryBlockSize);
-            Stats->Unused -= PrevMemoryBlockUnusedBytes;
-            Stats->Wasted += PrevMemoryBlockUnusedBytes;
+            SubtractFromStatistic(&Stats->Unused, PrevMemoryBlockUnusedBytes);
+            AddToStatistic(&Stats->Wasted, PrevMemoryBlockUnusedBytes);
         }
         
         static void AlterStatsOnMemoryBlockDeallocation
-        (statistics* Stats, u32 MemoryBlockToDeallocateSize, u32 PrevMemoryBlockUnusedBytes)
+        (statistics* Stats, size MemoryBlockToDeallocateSize, size PrevMemoryBlockUnusedBytes)
         {
             SubtractSizeAndUnused(Stats, MemoryBlockToDeallocateSize, PrevMemoryBlockUnusedBytes);
-            Stats->Unused += PrevMemoryBlockUnusedBytes;
-            Stats->Wasted -= PrevMemoryBlockUnusedBytes;
+            AddToStatistic(&Stats->Unused, PrevMemoryBlockUnusedBytes);
+            SubtractFromStatistic(&Stats->Wasted, PrevMemoryBlockUnusedBytes);
         }
         
-        void RegisterCreateArena
-        (arena& Arena, const char* ArenaName, const char* MasterArenaName, calling_info CallingInfo)
+        // NOTE: Returns the name by which the arena is identified
+        static const char* InternalRegisterCreateArena
+        (size ArenaSize, const char* ArenaName, const char* MasterArenaName, calling_info CallingInfo)
         {
-            if(!State.RegisterAllocations)
-                return;
-            
-            ScopeNoAllocRegistration;
-            
-            auto& MemGroup = *State.CurrentMemoryGroup;
-            auto& ArenaDebug = MemGroup.Arenas.PushZero();
-            
-            ArenaDebug.MemoryBlocks = ShareArena(State.Arena);
-            ArenaDebug.MemoryBlocks.Push(*Arena.MemoryBlock);
+            u32 ArenaIndex = State.Arenas.Count;
+            auto& ArenaDebug = State.Arenas.PushZero();
+            ArenaDebug.MemoryGroupId = CurrentMemoryGroupId;
+            ArenaDebug.CreationCallingInfo = CallingInfo;
+            ArenaDebug.MasterArenaName = MasterArenaName;
+            ArenaDebug.MemoryBlockCount = 1;
             
-            u32 ArenaSize = Arena.MemoryBlock->Size;
             AddSizeAndUnused(&ArenaDebug.Stats, ArenaSize);
             AddSizeAndUnused(&State.Stats, ArenaSize);
             
-            ArenaDebug.CreationCallingInfo = CallingInfo;
-            
             if(ArenaName)
             {
-                Arena.DebugName = ArenaDebug.Name = ArenaName;
+                ArenaDebug.Name = ArenaName;
             }
             else
             {
-                u32 MemGroupArenaCount = MemGroup.Arenas.GetCount();
-                auto& Name = State.NamelessAllocatorNames.PushUninitialized();
-                Name = Format<allocator_name>("nameless %", MemGroupArenaCount);
-                Arena.DebugName = ArenaDebug.Name = Name;
-                ArenaDebug.HasNamelessName = true;
+                ArenaDebug.NamelessName = Format<allocator_name>("nameless %", ArenaIndex);
+                ArenaDebug.Name = ArenaDebug.NamelessName.GetCString();
             }
             
-            ArenaDebug.MasterArenaName = MasterArenaName;
+            // NOTE: Arenas are identified by the DebugName pointer
+            AddIndex(State.ArenaTable, Hash(ArenaDebug.Name), ArenaIndex);
+            AtomicIncrement(State.ArenaGeneration);
             
             EndNextCallMemoryGroup();
+            return ArenaDebug.Name;
         }
         
-        static arena_debug_data& GetArenaDebug
-        (arena Arena)
+        void RegisterCreateArena
+        (arena& Arena, const char* ArenaName, const char* MasterArenaName, calling_info CallingInfo)
+        {
+            scope_registration Registration;
+            if(Registration.Entered)
+                Arena.DebugName = InternalRegisterCreateArena(Arena.MemoryBlock->Size, ArenaName, MasterArenaName, CallingInfo);
+        }
+        
+        void RegisterCreateArena
+        (concurrent_arena& Arena, const char* ArenaName, calling_info CallingInfo)
+        {
+            scope_registration Registration;
+            if(Registration.Entered)
+                Arena.DebugName = InternalRegisterCreateArena(Arena.MemoryBlock->Size, ArenaName, nullptr, CallingInfo);
+        }
+        
+        // NOTE: Returns nullptr for arenas which were created before Init()
+        static arena_debug_data* GetArenaDebug
+        (const char* DebugName)
+        {
+            u32 ArenaIndex = FindIndex(State.ArenaTable, Hash(DebugName), [&](u32 Index)
+                                       {
+                                           auto& ArenaDebug = State.Arenas[Index];
+                                           return ArenaDebug.Name == DebugName && !ArenaDebug.Deallocated;
+                                       });
+            return ArenaIndex != InvalidU32 ? &State.Arenas[ArenaIndex] : nullptr;
+        }
+        
+        static arena_debug_data* GetArenaDebug(arena Arena)
+        { return GetArenaDebug(Arena.DebugName); }
+        
+        void RegisterDeallocateArena
+        (arena Arena, calling_info CallingInfo)
         {
-            arena_debug_data* ArenaDebug = nullptr;
+            scope_registration Registration;
+            if(!Registration.Entered)
+                return;
             
-            for(auto& MemGroup : State.MemoryGroups)
+            if(auto* ArenaDebug = GetArenaDebug(Arena))
             {
-                ArenaDebug = Find(MemGroup.Arenas,
-                                  [=](auto Ad){ return Ad.Name == Arena.DebugName; });
-                
-                if(ArenaDebug)
-                    break;
+                ArenaDebug->Deallocated = true;
+                AtomicIncrement(State.ArenaGeneration);
             }
+        }
+        
+        void RegisterDeallocateArena
+        (concurrent_arena& Arena)
+        {
+            scope_registration Registration;
+            if(!Registration.Entered)
+                return;
             
-            rstd_Assert(ArenaDebug);
-            return *ArenaDebug;
+            if(auto* ArenaDebug = GetArenaDebug(Arena.DebugName))
+            {
+                ArenaDebug->Deallocated = true;
+                AtomicIncrement(State.ArenaGeneration);
+            }
         }
         
         void RegisterArenaAllocateNextMemoryBlock
         (arena Arena)
         {
-            if(!State.RegisterAllocations)
+            scope_registration Registration;
+            if(!Registration.Entered)
                 return;
             
-            ScopeNoAllocRegistration;
+            auto* ArenaDebug = GetArenaDebug(Arena);
+            if(!ArenaDebug)
+                return;
             
             auto* NewMemBlock = Arena.MemoryBlock;
-            auto& ArenaDebug = GetArenaDebug(Arena);
-            ArenaDebug.MemoryBlocks.Push(*NewMemBlock);
-            
             rstd_AssertM(NewMemBlock->Prev, "Pay attention to word 'Next' in function name");
+            ++ArenaDebug->MemoryBlockCount;
             
-            u32 PrevMemBlockUnused = GetUnusedBytes(*NewMemBlock->Prev);
-            AlterStatsOnMemoryBlockAllocation(&ArenaDebug.Stats, NewMemBlock->Size, PrevMemBlockUnused);
+            size PrevMemBlockUnused = GetUnusedBytes(*NewMemBlock->Prev);
+            AlterStatsOnMemoryBlockAllocation(&ArenaDebug->Stats, NewMemBlock->Size, PrevMemBlockUnused);
             AlterStatsOnMemoryBlockAllocation(&State.Stats, NewMemBlock->Size, PrevMemBlockUnused);
         }
         
+        // NOTE: Other threads still take slabs from the previous block, so what's left in it isn't counted as wasted
+        void RegisterArenaAllocateNextMemoryBlock
+        (concurrent_arena& Arena, memory_block& NewMemoryBlock)
+        {
+            scope_registration Registration;
+            if(!Registration.Entered)
+                return;
+            
+            auto* ArenaDebug = GetArenaDebug(Arena.DebugName);
+            if(!ArenaDebug)
+                return;
+            
+            ++ArenaDebug->MemoryBlockCount;
+            AddSizeAndUnused(&ArenaDebug->Stats, NewMemoryBlock.Size);
+            AddSizeAndUnused(&State.Stats, NewMemoryBlock.Size);
+        }
+        
         void RegisterArenaDeallocateMemoryBlock
         (arena Arena)
         {
-            if(!State.RegisterAllocations)
+            scope_registration Registration;
+            if(!Registration.Entered)
                 return;
             
-            ScopeNoAllocRegistration;
+            auto* ArenaDebug = GetArenaDebug(Arena);
+            if(!ArenaDebug)
+                return;
             
             auto& MemBlockToDeallocate = *Arena.MemoryBlock;
-            auto& ArenaDebug = GetArenaDebug(Arena);
-            ArenaDebug.MemoryBlocks.PopLast();
+            --ArenaDebug->MemoryBlockCount;
             
             auto* PrevMemBlock = MemBlockToDeallocate.Prev;
-            u32 PrevMemBlockUnused = PrevMemBlock ? GetUnusedBytes(*PrevMemBlock) : 0;
-            AlterStatsOnMemoryBlockDeallocation(&ArenaDebug.Stats, MemBlockToDeallocate.Size, PrevMemBlockUnused);
+            size PrevMemBlockUnused = PrevMemBlock ? GetUnusedBytes(*PrevMemBlock) : 0;
+            AlterStatsOnMemoryBlockDeallocation(&ArenaDebug->Stats, MemBlockToDeallocate.Size, PrevMemBlockUnused);
             AlterStatsOnMemoryBlockDeallocation(&State.Stats, MemBlockToDeallocate.Size, PrevMemBlockUnused);
         }
         
         void SetDebugTemporaryMemory
         (temporary_memory TempMem, rstd_bool Flag)
         {
-            auto& ArenaDebug = GetArenaDebug(*TempMem.Arena);
-            ArenaDebug.TemporaryMemory = Flag;
+            scope_registration Registration;
+            if(!Registration.Entered)
+                return;
+            
+            if(auto* ArenaDebug = GetArenaDebug(*TempMem.Arena))
+                ArenaDebug->TemporaryMemory = Flag;
         }
         
         void RegisterBeginTemporaryMemory(temporary_memory TempMem)
@@ -7016,43 +10164,166 @@ namespace rstd
         void RegisterEndTemporaryMemory(temporary_memory TempMem)
         { SetDebugTemporaryMemory(TempMem, false); }
         
-        void RegisterArenaPush
-        (arena Arena, push_size_uninitialized_ex_res Res, size Size,
-         allocation_type AllocationType, calling_info CallingInfo)
+        static u32 GetCallsiteIndex
+        (callsite_table& Sites, calling_info CallingInfo, u32 MemoryGroupId, allocation_type Type)
         {
-            if(!State.RegisterAllocations)
-                return;
+            u64 CallsiteHash = Hash(Hash(CallingInfo.FilePath) ^
+                                    ((u64)CallingInfo.Line << 32 | (u64)MemoryGroupId << 8 | (u64)Type));
+            
+            u32 CallsiteIndex = FindIndex(Sites.Table, CallsiteHash, [&](u32 Index)
+                                          {
+                                              auto& Callsite = Sites.Callsites[Index];
+                                              return Callsite.CallingInfo.FilePath == CallingInfo.FilePath &&
+                                                  Callsite.CallingInfo.Line == CallingInfo.Line &&
+                                                  Callsite.MemoryGroupId == MemoryGroupId &&
+                                                  Callsite.Type == Type;
+                                          });
+            
+            if(CallsiteIndex == InvalidU32)
+            {
+                CallsiteIndex = Sites.Callsites.Count;
+                auto& Callsite = Sites.Callsites.PushZero();
+                Callsite.CallingInfo = CallingInfo;
+                Callsite.MemoryGroupId = MemoryGroupId;
+                Callsite.Type = Type;
+                AddIndex(Sites.Table, CallsiteHash, CallsiteIndex);
+            }
             
-            ScopeNoAllocRegistration;
+            return CallsiteIndex;
+        }
+        
+        static u32 CountAllocation
+        (callsite_table& Sites, calling_info CallingInfo, allocation_type Type, size Size)
+        {
+            u32 CallsiteIndex = GetCallsiteIndex(Sites, CallingInfo, CurrentMemoryGroupId, Type);
+            auto& Callsite = Sites.Callsites[CallsiteIndex];
+            ++Callsite.Count;
+            Callsite.Bytes += Size;
+            Callsite.LiveBytes += Size;
+            if(Callsite.LiveBytes > Callsite.PeakLiveBytes)
+                Callsite.PeakLiveBytes = Callsite.LiveBytes;
+            return CallsiteIndex;
+        }
+        
+        static void RecordAllocation
+        (calling_info CallingInfo, const char* AllocatorName, void* Memory, size Size, allocation_type Type)
+        {
+#if rstd_MemoryProfilerRecordAllocations
+            State.Allocations.Push({CallingInfo, AllocatorName, Memory, Size, Type, CurrentMemoryGroupId});
+#endif
+        }
+        
+        static thread_state& InternalGetThreadState()
+        {
+            if(!ThreadState)
+            {
+                auto Arena = rstd_AllocateArenaZero(KilobytesToBytes(64), "Memory debug thread");
+                auto* Thread = &rstd_PushStructZero(Arena, thread_state);
+                Thread->Arena = Arena;
+                Thread->Callsites.Callsites.Init(ShareArena(Thread->Arena));
+                Thread->Arenas.Init(ShareArena(Thread->Arena));
+                
+                rstd_ScopeLock(State.Mutex);
+                Thread->Next = State.ThreadStates;
+                State.ThreadStates = Thread;
+                ThreadState = Thread;
+            }
+            return *ThreadState;
+        }
+        
+        // NOTE: The arena table is looked up under State.Mutex only the first time the thread pushes to an arena
+        //       and after arenas were created or deallocated, otherwise the pointer cached by the thread is used
+        static arena_debug_data* GetCachedArenaDebug
+        (thread_state& Thread, const char* DebugName)
+        {
+            u32 Generation = AtomicLoad<memory_order::Acquire>(State.ArenaGeneration);
+            u64 NameHash = Hash(DebugName);
+            u32 CacheIndex = FindIndex(Thread.ArenaTable, NameHash,
+                                       [&](u32 Index){ return Thread.Arenas[Index].DebugName == DebugName; });
+            if(CacheIndex != InvalidU32 && Thread.Arenas[CacheIndex].Generation == Generation)
+                return Thread.Arenas[CacheIndex].ArenaDebug;
             
-            auto& DebugArena = GetArenaDebug(Arena);
+            arena_debug_data* ArenaDebug;
+            {
+                rstd_ScopeLock(State.Mutex);
+                Generation = State.ArenaGeneration;
+                ArenaDebug = GetArenaDebug(DebugName);
+            }
             
-            if(DebugArena.TemporaryMemory)
+            if(CacheIndex == InvalidU32)
+            {
+                AddIndex(Thread.ArenaTable, NameHash, Thread.Arenas.Count);
+                Thread.Arenas.Push({DebugName, ArenaDebug, Generation});
+            }
+            else
+            {
+                Thread.Arenas[CacheIndex].ArenaDebug = ArenaDebug;
+                Thread.Arenas[CacheIndex].Generation = Generation;
+            }
+            return ArenaDebug;
+        }
+        
+        static void InternalRegisterPush
+        (const char* DebugName, void* Memory, size Size, allocation_type AllocationType, calling_info CallingInfo,
+         rstd_bool SkipTemporaryMemory)
+        {
+            scope_thread_registration Registration;
+            if(!Registration.Entered)
                 return;
             
-            allocation Alloc = {CallingInfo, DebugArena.Name, Res.Memory, Size, AllocationType};
-            auto& MemGroup = *State.CurrentMemoryGroup;
-            MemGroup.Allocations.PushFront(Alloc);
+            auto& Thread = InternalGetThreadState();
+            auto* ArenaDebug = GetCachedArenaDebug(Thread, DebugName);
+            if(!ArenaDebug || (SkipTemporaryMemory && ArenaDebug->TemporaryMemory))
+                return;
             
-            auto& DebugMemBlock = DebugArena.MemoryBlocks.GetLast();
-            DebugMemBlock = *Arena.MemoryBlock;
-            AddUsedAndSubtractUnused(&DebugArena.Stats, Size);
+            CountAllocation(Thread.Callsites, CallingInfo, AllocationType, Size);
+#if rstd_MemoryProfilerRecordAllocations
+            {
+                rstd_ScopeLock(State.Mutex);
+                RecordAllocation(CallingInfo, ArenaDebug->Name, Memory, Size, AllocationType);
+            }
+#endif
+            AddUsedAndSubtractUnused(&ArenaDebug->Stats, Size);
             AddUsedAndSubtractUnused(&State.Stats, Size);
             
             EndNextCallMemoryGroup();
         }
         
+        void RegisterArenaPush
+        (arena Arena, push_size_uninitialized_ex_res Res, size Size,
+         allocation_type AllocationType, calling_info CallingInfo)
+        { InternalRegisterPush(Arena.DebugName, Res.Memory, Size, AllocationType, CallingInfo, true); }
+        
+        void RegisterArenaPush
+        (concurrent_arena& Arena, void* Memory, size Size, allocation_type AllocationType, calling_info CallingInfo)
+        { InternalRegisterPush(Arena.DebugName, Memory, Size, AllocationType, CallingInfo, false); }
+        
         void RegisterGenAlloc
         (void* Memory, size Size, calling_info CallingInfo)
         {
-            if(!State.RegisterAllocations)
+            scope_registration Registration;
+            if(!Registration.Entered)
                 return;
             
-            ScopeNoAllocRegistration;
+            u32 CallsiteIndex = CountAllocation(State.GenAllocCallsites, CallingInfo, allocation_type::GenAlloc, Size);
+            RecordAllocation(CallingInfo, "malloc", Memory, Size, allocation_type::GenAlloc);
+            
+            // NOTE: malloc reuses freed addresses, so their entries are reused as well
+            u64 MemoryHash = Hash(Memory);
+            u32 AllocationIndex = FindIndex(State.LiveAllocationTable, MemoryHash,
+                                            [=](u32 Index){ return State.LiveAllocations[Index].Memory == Memory; });
+            if(AllocationIndex == InvalidU32)
+            {
+                AllocationIndex = State.LiveAllocations.Count;
+                State.LiveAllocations.PushUninitialized();
+                AddIndex(State.LiveAllocationTable, MemoryHash, AllocationIndex);
+            }
+            else
+            {
+                rstd_AssertM(!State.LiveAllocations[AllocationIndex].Live, "malloc returned memory which wasn't freed");
+            }
+            State.LiveAllocations[AllocationIndex] = {Memory, Size, CallsiteIndex, true};
             
-            allocation Alloc = {CallingInfo, "malloc", Memory, Size, allocation_type::GenAlloc};
-            auto& MemGroup = *State.CurrentMemoryGroup;
-            MemGroup.Allocations.PushFront(Alloc);
             AddUsedAndSubtractUnused(&State.Stats, Size);
             AddSizeAndUnused(&State.Stats, Size);
             EndNextCallMemoryGroup();
@@ -7061,58 +10332,125 @@ namespace rstd
         void RegisterGenFree
         (void* Memory, calling_info CallingInfo)
         {
-            if(!State.RegisterAllocations)
+            scope_registration Registration;
+            if(!Registration.Entered)
                 return;
             
-            ScopeNoAllocRegistration;
-            
-            auto& MemGroup = *State.CurrentMemoryGroup;
+            u32 AllocationIndex = FindIndex(State.LiveAllocationTable, Hash(Memory),
+                                            [=](u32 Index){ return State.LiveAllocations[Index].Memory == Memory; });
+            if(AllocationIndex == InvalidU32)
+            {
+                rstd_InvalidCodePathM("Memory was never allocated!");
+                return;
+            }
             
-            auto AllocComparison = [=](auto Alloc){ return Alloc.Memory == Memory; };
-            auto* FoundAlloc = Find(MemGroup.Allocations, AllocComparison);
-            if(!FoundAlloc)
+            auto& Allocation = State.LiveAllocations[AllocationIndex];
+            if(!Allocation.Live)
             {
-                for(auto& Mg : State.MemoryGroups)
-                {
-                    if(&Mg != &MemGroup)    
-                    {
-                        FoundAlloc = Find(Mg.Allocations, AllocComparison);
-                        if(FoundAlloc)
-                            break;
-                    }    
-                }
+                rstd_InvalidCodePathM("Memory was already freed!");
+                return;
             }
             
-            if(FoundAlloc)
+            Allocation.Live = false;
+            auto& Callsite = State.GenAllocCallsites.Callsites[Allocation.CallsiteIndex];
+            Callsite.LiveBytes -= Allocation.Size;
+            ++Callsite.FreeCount;
+            SubtractUsedAndAddUnused(&State.Stats, Allocation.Size);
+            SubtractSizeAndUnused(&State.Stats, Allocation.Size, 0);
+        }
+        
+        static const char* ToString
+        (allocation_type Type)
+        {
+            switch(Type)
             {
-                MemGroup.Allocations.Remove(FoundAlloc);
-                MemGroup.Deallocations.Push({FoundAlloc->Memory, allocation_type::GenAlloc});
-                SubtractUsedAndAddUnused(&State.Stats, FoundAlloc->Size);
-                SubtractSizeAndUnused(&State.Stats, FoundAlloc->Size, 0);
+                case allocation_type::ArenaPushUninitialized: return "push uninitialized";
+                case allocation_type::ArenaPushZero: return "push zero";
+                case allocation_type::ArenaPushStringCopy: return "push string copy";
+                case allocation_type::GenAlloc: return "malloc";
+                rstd_InvalidDefaultCase;
             }
-            else
+            return "";
+        }
+        
+        // NOTE: The same callsite can be in the tables of several threads. Peaks of live bytes are summed,
+        //       so the merged peak is an upper bound.
+        static void MergeCallsites
+        (callsite_table& Merged, callsite_table& Sites)
+        {
+            for(auto& Callsite : Sites.Callsites)
+            {
+                u32 MergedIndex = GetCallsiteIndex(Merged, Callsite.CallingInfo, Callsite.MemoryGroupId, Callsite.Type);
+                auto& MergedCallsite = Merged.Callsites[MergedIndex];
+                MergedCallsite.Count += Callsite.Count;
+                MergedCallsite.FreeCount += Callsite.FreeCount;
+                MergedCallsite.Bytes += Callsite.Bytes;
+                MergedCallsite.LiveBytes += Callsite.LiveBytes;
+                MergedCallsite.PeakLiveBytes += Callsite.PeakLiveBytes;
+            }
+        }
+        
+        // NOTE: Other threads shouldn't push while the report is written, their tables are read without a lock
+        void WriteReport
+        (file_stream& Stream)
+        {
+            scope_registration Registration;
+            if(!Registration.Entered)
+                return;
+            
+            auto& Stats = State.Stats;
+            WriteString(Stream, "used: % (peak %), size: % (peak %), wasted: %\n\n",
+                        GetChoppedSizeText((u64)Stats.Used), GetChoppedSizeText((u64)Stats.UsedPeak),
+                        GetChoppedSizeText((u64)Stats.Size), GetChoppedSizeText((u64)Stats.SizePeak),
+                        GetChoppedSizeText((u64)Stats.Wasted));
+            
+            WriteString(Stream, "arena, master arena, memory group, blocks, used, used peak, size, wasted\n");
+            for(auto& ArenaDebug : State.Arenas)
             {
-                auto DeallocComparison = [=](auto Dealloc){ return Dealloc.Memory == Memory; };
-                auto* FoundFreedMemory = Find(MemGroup.Deallocations, DeallocComparison);
-                if(!FoundFreedMemory)
+                if(!ArenaDebug.Deallocated)
                 {
-                    for(auto& Mg : State.MemoryGroups)
-                    {
-                        if(&Mg != &MemGroup)    
-                        {
-                            FoundFreedMemory = Find(Mg.Deallocations, DeallocComparison);
-                            if(FoundFreedMemory)
-                                break;
-                        }    
-                    }
+                    WriteString(Stream, "%, %, %, %, %, %, %, %\n", ArenaDebug.Name,
+                                ArenaDebug.MasterArenaName ? ArenaDebug.MasterArenaName : "",
+                                State.MemoryGroups[ArenaDebug.MemoryGroupId], ArenaDebug.MemoryBlockCount,
+                                (u64)ArenaDebug.Stats.Used, (u64)ArenaDebug.Stats.UsedPeak,
+                                (u64)ArenaDebug.Stats.Size, (u64)ArenaDebug.Stats.Wasted);
                 }
-                
-                rstd_InvalidCodePathM(FoundFreedMemory ?
-                                      "Memory was already freed!" : "Memory was never allocated!");
             }
+            
+            auto MergeArena = rstd_AllocateArenaZero(KilobytesToBytes(64), "Memory debug report");
+            callsite_table Merged = {};
+            Merged.Callsites.Init(ShareArena(MergeArena));
+            MergeCallsites(Merged, State.GenAllocCallsites);
+            for(auto* Thread = State.ThreadStates; Thread; Thread = Thread->Next)
+                MergeCallsites(Merged, Thread->Callsites);
+            
+            // NOTE: Callsites are sorted by allocated bytes, most first
+            u32 CallsiteCount = Merged.Callsites.Count;
+            auto* Order = CallsiteCount ? (u32*)PageAlloc(CallsiteCount * sizeof(u32)) : nullptr;
+            rstd_For(CallsiteIndex, CallsiteCount)
+                Order[CallsiteIndex] = CallsiteIndex;
+            std::sort(Order, Order + CallsiteCount, [&](u32 A, u32 B)
+                      { return Merged.Callsites[A].Bytes > Merged.Callsites[B].Bytes; });
+            
+            WriteString(Stream, "\nmemory group, file, line, function, type, count, frees, bytes, live bytes, peak live bytes\n");
+            rstd_For(OrderIndex, CallsiteCount)
+            {
+                auto& Callsite = Merged.Callsites[Order[OrderIndex]];
+                WriteString(Stream, "%, %, %, %, %, %, %, %, %, %\n",
+                            State.MemoryGroups[Callsite.MemoryGroupId], Callsite.CallingInfo.FilePath,
+                            Callsite.CallingInfo.Line, Callsite.CallingInfo.Function, ToString(Callsite.Type),
+                            Callsite.Count, Callsite.FreeCount, Callsite.Bytes,
+                            Callsite.LiveBytes, Callsite.PeakLiveBytes);
+            }
+            
+            if(Order)
+                PageFree(Order);
+            if(Merged.Table.Slots)
+                PageFree(Merged.Table.Slots);
+            DeallocateArena(MergeArena);
         }
     }
-    
+
 #endif // rstd_MemoryProfilerEnabled
     
 }
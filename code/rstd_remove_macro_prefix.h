@@ -29,4 +29,6 @@
 #define For rstd_For
 #define ForF32 rstd_ForF32
 #define ArrayCount rstd_ArrayCount
-#define ScopeLock rstd_ScopeLock
\ No newline at end of file
+#define ScopeLock rstd_ScopeLock
+#define TimeBlock rstd_TimeBlock
+#define TimeFunction rstd_TimeFunction
\ No newline at end of file
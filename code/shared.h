@@ -18,26 +18,46 @@ fn ShowInfoMessageBoxAndCloseApp
 enum ended_on
 { Nothing, Start, End };
 
-fn WhatSaveFileEndedOn
-(file File, u32 FileSize)
+struct last_entry
 {
-    auto Arena = AllocateArenaZero(4_MB);
-    char* FileContent = (char*)PushSizeUninitialized(Arena, FileSize);
-    u32 ReadBytes = Read(FileContent, File, 0, FileSize);
-    RAssert(ReadBytes == FileSize, "Failed to read save.txt! (although the file was opened successfully.)");
-    ended_on EndedOn = Nothing;
-    while(*FileContent)
+    ended_on Type;
+    time Time;
+};
+
+// NOTE: This runs on every hotkey press so it reads only the tail of save.txt into a stack buffer,
+//       no arena and no reading thread
+fn ReadLastEntry
+(file File, u64 FileSize)
+{
+    constexpr u32 WindowSize = 1024;
+    constexpr u32 MaxLineLength = 256;
+    char Buffer[WindowSize + MaxLineLength + 1];
+    backward_line_reader Reader;
+    Init(Reader, Buffer, File, 0, FileSize, WindowSize, MaxLineLength);
+    
+    last_entry Res = {};
+    string_view Line;
+    while(ReadPreviousLine(Reader, Line))
     {
-        if(*FileContent == 's')
-            EndedOn = Start;
-        else if(*FileContent == 'e')
-            EndedOn = End;
+        char* At = Line.GetCString();
+        if(*At == 0)
+            continue;
+        
+        if(*At == 's')
+            Res.Type = Start;
+        else if(*At == 'e')
+            Res.Type = End;
         else
             RInvalidCodePath("save.txt is corrupted!");
         
-        while(*FileContent != '\n' && *FileContent != 0)
-            ++FileContent;
-        ++FileContent;
+        At += strlen("s:");
+        Res.Time = ReadTime(&At);
+        break;
     }
-    return EndedOn;
-}
\ No newline at end of file
+    
+    Close(Reader);
+    return Res;
+}
+
+fn WhatSaveFileEndedOn(file File, u64 FileSize)
+{ return ReadLastEntry(File, FileSize).Type; }
@@ -0,0 +1,130 @@
+#include "shared.h"
+
+// NOTE: Measures the hotkey tools from CreateProcess() until they exit, at which point save.txt is written.
+//       It has to be run from the directory with the built executables. The tools are run on a generated
+//       save.txt in a temporary directory, so the real one isn't touched.
+//       A tool whose median CPU time is over its budget is flagged and the benchmark exits with 1.
+//       Usage: startup_benchmark [number of runs] [number of entries in the generated save.txt]
+
+constexpr const char* BenchmarkDirectory = "startup_benchmark_tmp";
+
+// NOTE: The tools run on every keypress, so all of them should stay well under a millisecond of CPU
+constexpr u64 HotkeyToolCpuBudgetMicroseconds = 1000;
+
+struct tool
+{
+    const char* Name;
+    const char* Arguments;
+    u64 CpuBudgetMicroseconds;
+    u64* WallMicroseconds;
+    u64* CpuMicroseconds;
+};
+
+fn GenerateSaveFile
+(arena& Arena, u32 EntryCount)
+{
+    auto Path = Format("%\\save.txt", BenchmarkDirectory);
+    auto Stream = OpenFileStream(Path.GetCString(), io_mode::Write, Arena);
+    RAssert(Stream, "Failed to create \"%\"!\nWin32 error code: %", Path, GetSystemErrorCode());
+    
+    // NOTE: Entries go back from now by 1 hour so the log ends on a pause and starting the timer is valid
+    auto Time = AddSeconds(GetLocalTime(), -(i64)EntryCount * SecondsPerHour);
+    rstd_For(EntryIndex, EntryCount)
+    {
+        rstd_bool EndEntry = (EntryCount - EntryIndex) % 2 == 1;
+        WriteString(Stream, EntryIndex ? "\n%:%" : "%:%", EndEntry ? "e" : "s", ToString(Time));
+        Time = AddSeconds(Time, SecondsPerHour);
+    }
+    Close(Stream);
+}
+
+fn FileTimeToMicroseconds(FILETIME Time)
+{ return (((u64)Time.dwHighDateTime << 32) | Time.dwLowDateTime) / 10; }
+
+fn RunTool
+(tool& Tool, const char* ExecutableDirectory, u32 RunIndex, i64 PerformanceFrequency)
+{
+    auto CommandLine = Format<string<512>>("\"%\\%.exe\" %", ExecutableDirectory, Tool.Name, Tool.Arguments);
+    
+    STARTUPINFOA StartupInfo = {};
+    StartupInfo.cb = sizeof(StartupInfo);
+    PROCESS_INFORMATION ProcessInfo = {};
+    
+    LARGE_INTEGER Begin, End;
+    QueryPerformanceCounter(&Begin);
+    BOOL Created = CreateProcessA(nullptr, CommandLine.GetCString(), nullptr, nullptr, FALSE, 0, nullptr,
+                                  BenchmarkDirectory, &StartupInfo, &ProcessInfo);
+    RAssert(Created, "Failed to run %\nWin32 error code: %", CommandLine, GetSystemErrorCode());
+    WaitForSingleObject(ProcessInfo.hProcess, INFINITE);
+    QueryPerformanceCounter(&End);
+    
+    FILETIME CreationTime, ExitTime, KernelTime, UserTime;
+    GetProcessTimes(ProcessInfo.hProcess, &CreationTime, &ExitTime, &KernelTime, &UserTime);
+    CloseHandle(ProcessInfo.hThread);
+    CloseHandle(ProcessInfo.hProcess);
+    
+    Tool.WallMicroseconds[RunIndex] = (u64)(End.QuadPart - Begin.QuadPart) * 1000000 / (u64)PerformanceFrequency;
+    Tool.CpuMicroseconds[RunIndex] = FileTimeToMicroseconds(KernelTime) + FileTimeToMicroseconds(UserTime);
+}
+
+int main
+(i32 ArgumentCount, char** Arguments)
+{
+    u32 RunCount = ArgumentCount > 1 ? StringToU32(Arguments[1]) : 100;
+    u32 EntryCount = ArgumentCount > 2 ? StringToU32(Arguments[2]) : 100000;
+    RAssert(RunCount > 0, "Number of runs has to be bigger than 0");
+    
+    auto Arena = AllocateArenaZero(1_MB);
+    
+    char ExecutablePath[MAX_PATH];
+    GetModuleFileNameA(nullptr, ExecutablePath, MAX_PATH);
+    *strrchr(ExecutablePath, '\\') = 0;
+    
+    CreateDirectory(BenchmarkDirectory);
+    GenerateSaveFile(Arena, EntryCount);
+    
+    // NOTE: This order keeps the log valid for every tool, so none of them stops on a message box
+    tool Tools[] =
+    {
+        {"start_timer", "", HotkeyToolCpuBudgetMicroseconds},
+        {"timer_add_break", "5", HotkeyToolCpuBudgetMicroseconds},
+        {"pause_timer", "", HotkeyToolCpuBudgetMicroseconds},
+    };
+    for(auto& Tool : Tools)
+    {
+        Tool.WallMicroseconds = rstd_PushArrayUninitialized(Arena, u64, RunCount);
+        Tool.CpuMicroseconds = rstd_PushArrayUninitialized(Arena, u64, RunCount);
+    }
+    
+    LARGE_INTEGER PerformanceFrequency;
+    QueryPerformanceFrequency(&PerformanceFrequency);
+    rstd_For(RunIndex, RunCount)
+    {
+        for(auto& Tool : Tools)
+            RunTool(Tool, ExecutablePath, RunIndex, PerformanceFrequency.QuadPart);
+    }
+    
+    DeleteDirectoryWithAllContents(BenchmarkDirectory);
+    
+    auto Stream = OpenStandardOutputStream(Arena);
+    WriteString(Stream, "% runs, save.txt with % entries, times in ms\n", RunCount, EntryCount);
+    WriteString(Stream, "tool, wall min, wall median, wall p90, cpu median, cpu budget, over budget\n");
+    auto Milliseconds = [](u64 Microseconds){ return FixedPointToString<16>(Microseconds, 1000, 3); };
+    rstd_bool OverBudget = false;
+    for(auto& Tool : Tools)
+    {
+        std::sort(Tool.WallMicroseconds, Tool.WallMicroseconds + RunCount);
+        std::sort(Tool.CpuMicroseconds, Tool.CpuMicroseconds + RunCount);
+        u64 CpuMedian = Tool.CpuMicroseconds[RunCount / 2];
+        rstd_bool ToolOverBudget = CpuMedian > Tool.CpuBudgetMicroseconds;
+        OverBudget = OverBudget || ToolOverBudget;
+        WriteString(Stream, "%, %, %, %, %, %, %\n", Tool.Name,
+                    Milliseconds(Tool.WallMicroseconds[0]),
+                    Milliseconds(Tool.WallMicroseconds[RunCount / 2]),
+                    Milliseconds(Tool.WallMicroseconds[RunCount * 9 / 10]),
+                    Milliseconds(CpuMedian), Milliseconds(Tool.CpuBudgetMicroseconds),
+                    ToolOverBudget ? "YES" : "no");
+    }
+    Flush(Stream);
+    return OverBudget ? 1 : 0;
+}
@@ -0,0 +1,115 @@
+#include "shared.h"
+
+// NOTE: Measures how many small jobs per second go through thread_pool when 1..N threads push them.
+//       The pool has one worker per logical processor and the producers are separate threads.
+//       Usage: thread_pool_benchmark [jobs per producer] [max number of producers]
+//       Build it with -Drstd_ThreadPoolTelemetryEnabled=1 to also get the pool telemetry of all runs.
+
+struct producer
+{
+    thread_pool* Pool;
+    u32 JobCount;
+    u32 Index;
+    void* StartEventHandle;
+};
+
+// NOTE: Every thread which runs jobs counts them in its own cache line, so counting doesn't make
+//       the workers fight over one variable. Producers run jobs too when the queue is full,
+//       they use the first MAXIMUM_WAIT_OBJECTS counters, workers and the main thread take the next ones.
+struct alignas(64) job_counter
+{ u64 Count; };
+
+constexpr u32 JobCounterCount = MAXIMUM_WAIT_OBJECTS + rstd_ThreadPoolMaxThreadCount + 1;
+global job_counter JobCounters[JobCounterCount];
+global volatile u32 NextJobCounter = MAXIMUM_WAIT_OBJECTS;
+static thread_local job_counter* ThreadJobCounter;
+
+fn EmptyJob(void* Data)
+{
+    if(!ThreadJobCounter)
+    {
+        u32 CounterIndex = AtomicIncrement(NextJobCounter) - 1;
+        RAssert(CounterIndex < JobCounterCount, "Too many threads ran jobs");
+        ThreadJobCounter = &JobCounters[CounterIndex];
+    }
+    ++ThreadJobCounter->Count;
+}
+
+// NOTE: Called after CompleteAllJobs(), so every job has finished and its count is visible
+fn GetCompletedJobCount()
+{
+    u64 Count = 0;
+    for(auto& Counter : JobCounters)
+        Count += Counter.Count;
+    return Count;
+}
+
+DWORD WINAPI ProducerProc
+(LPVOID ProducerVoidPtr)
+{
+    auto& Producer = *(producer*)ProducerVoidPtr;
+    ThreadJobCounter = &JobCounters[Producer.Index];
+    WaitForSingleObjectEx(Producer.StartEventHandle, INFINITE, FALSE);
+    rstd_For(JobIndex, Producer.JobCount)
+        PushJob(*Producer.Pool, nullptr, EmptyJob);
+    return 0;
+}
+
+int main
+(i32 ArgumentCount, char** Arguments)
+{
+    u32 JobsPerProducer = ArgumentCount > 1 ? StringToU32(Arguments[1]) : 1000000;
+    u32 MaxProducerCount = ArgumentCount > 2 ? StringToU32(Arguments[2]) : GetLogicalProcessorCount();
+    RAssert(JobsPerProducer > 0 && MaxProducerCount > 0, "Number of jobs and producers has to be bigger than 0");
+    if(MaxProducerCount > MAXIMUM_WAIT_OBJECTS)
+        MaxProducerCount = MAXIMUM_WAIT_OBJECTS;
+    
+    auto Arena = AllocateArenaZero(64_KB);
+    thread_pool Pool;
+    Init(Pool, GetLogicalProcessorCount());
+    
+    LARGE_INTEGER PerformanceFrequency;
+    QueryPerformanceFrequency(&PerformanceFrequency);
+    
+    auto Stream = OpenStandardOutputStream(Arena);
+    WriteString(Stream, "% jobs per producer, % workers, queue size %\n", JobsPerProducer, Pool.ThreadCount, rstd_ThreadPoolQueueSize);
+    WriteString(Stream, "producers, jobs, ms, jobs per second\n");
+    for(u32 ProducerCount = 1; ProducerCount <= MaxProducerCount; ++ProducerCount)
+    {
+        for(auto& Counter : JobCounters)
+            Counter.Count = 0;
+        void* StartEventHandle = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+        auto* Producers = PushArrayZero(Arena, producer, ProducerCount);
+        auto* ThreadHandles = PushArrayZero(Arena, HANDLE, ProducerCount);
+        rstd_For(ProducerIndex, ProducerCount)
+        {
+            Producers[ProducerIndex] = {&Pool, JobsPerProducer, ProducerIndex, StartEventHandle};
+            ThreadHandles[ProducerIndex] = CreateThread(0, 0, ProducerProc, &Producers[ProducerIndex], 0, nullptr);
+        }
+        
+        LARGE_INTEGER Begin, End;
+        QueryPerformanceCounter(&Begin);
+        SetEvent(StartEventHandle);
+        WaitForMultipleObjects(ProducerCount, ThreadHandles, TRUE, INFINITE);
+        CompleteAllJobs(Pool);
+        QueryPerformanceCounter(&End);
+        
+        u64 JobCount = (u64)ProducerCount * JobsPerProducer;
+        u64 CompletedJobCount = GetCompletedJobCount();
+        RAssert(CompletedJobCount == JobCount, "% jobs were pushed, but % were completed", JobCount, CompletedJobCount);
+        
+        u64 Microseconds = (u64)(End.QuadPart - Begin.QuadPart) * 1000000 / (u64)PerformanceFrequency.QuadPart;
+        u64 JobsPerSecond = Microseconds ? JobCount * 1000000 / Microseconds : 0;
+        WriteString(Stream, "%, %, %, %\n", ProducerCount, JobCount, FixedPointToString<16>(Microseconds, 1000, 3), JobsPerSecond);
+        
+        rstd_For(ProducerIndex, ProducerCount)
+            CloseHandle(ThreadHandles[ProducerIndex]);
+        CloseHandle(StartEventHandle);
+    }
+    
+    WriteString(Stream, "\n");
+    if(!WriteTelemetry(Pool, Stream))
+        WriteString(Stream, "telemetry is disabled\n");
+    Flush(Stream);
+    Close(Pool);
+}